@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+HTTP load generator for the vzero web server
+
+Requests /api/plugins, /api/status and all sensor endpoints from
+concurrent clients and reports throughput, latency percentiles and the
+free heap low-water mark. Enable PLUGIN_SIMULATED for many sensors:
+
+    misc/loadgen.py vzero-edd834.local --concurrency 4 --duration 60
+"""
+
+import argparse
+import json
+import threading
+import time
+import urllib.error
+import urllib.request
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = {}
+        self.errors = {}
+        self.heap = None
+        self.minheap = None
+
+    def add(self, endpoint, latency, ok):
+        with self.lock:
+            self.latencies.setdefault(endpoint, []).append(latency)
+            if not ok:
+                self.errors[endpoint] = self.errors.get(endpoint, 0) + 1
+
+    def status(self, status):
+        # minheap is the low-water mark since the previous status request
+        with self.lock:
+            self.heap = status.get("heap")
+            minheap = status.get("minheap")
+            if minheap is not None and (self.minheap is None or minheap < self.minheap):
+                self.minheap = minheap
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def get(base, path, timeout):
+    with urllib.request.urlopen(base + path, timeout=timeout) as response:
+        return response.read()
+
+
+def endpoints(base, timeout):
+    paths = ["/api/plugins", "/api/status", "/api/values"]
+    for plugin in json.loads(get(base, "/api/plugins", timeout)):
+        for sensor in plugin.get("sensors", []):
+            paths.append("/api/%s/%s" % (plugin["name"], sensor["addr"]))
+    return paths
+
+
+def client(base, paths, offset, deadline, timeout, stats):
+    i = offset
+    while time.time() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        # per-sensor requests are reported together
+        endpoint = path if path.count("/") < 3 else "/api/<plugin>/<sensor>"
+        start = time.time()
+        try:
+            body = get(base, path, timeout)
+            ok = True
+            if path == "/api/status":
+                stats.status(json.loads(body))
+        except (urllib.error.URLError, OSError, ValueError):
+            ok = False
+        stats.add(endpoint, (time.time() - start) * 1000, ok)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host")
+    parser.add_argument("--concurrency", type=int, default=2)
+    parser.add_argument("--duration", type=int, default=30, help="s")
+    parser.add_argument("--timeout", type=float, default=10, help="s")
+    args = parser.parse_args()
+
+    base = "http://" + args.host
+    paths = endpoints(base, args.timeout)
+    print("%d endpoints, %d clients, %ds" % (len(paths), args.concurrency, args.duration))
+
+    stats = Stats()
+    deadline = time.time() + args.duration
+    threads = [threading.Thread(target=client, args=(base, paths, i * len(paths) // args.concurrency, deadline, args.timeout, stats))
+               for i in range(args.concurrency)]
+    start = time.time()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.time() - start
+
+    total = sum(len(latencies) for latencies in stats.latencies.values())
+    print("\n%-24s %7s %6s %7s %7s %7s %7s" % ("endpoint", "count", "errors", "p50", "p90", "p99", "max"))
+    for endpoint, latencies in sorted(stats.latencies.items()):
+        print("%-24s %7d %6d %7.0f %7.0f %7.0f %7.0f" % (endpoint, len(latencies), stats.errors.get(endpoint, 0),
+              percentile(latencies, 50), percentile(latencies, 90), percentile(latencies, 99), max(latencies)))
+    print("\nthroughput: %.1f req/s" % (total / elapsed))
+    print("errors:     %d" % sum(stats.errors.values()))
+    print("heap:       %s (min %s)" % (stats.heap, stats.minheap))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Volkszaehler middleware stand-in
+
+Accepts POST /data/<uuid>.json requests over HTTP/1.1 keep-alive and
+reports requests and connections per interval. --latency delays the first
+response of each new connection to emulate handshake round trips to a
+remote middleware, --idle closes connections after the given idle time like most servers do:
+
+    misc/middleware.py --port 8080 --latency 50 --idle 5
+"""
+
+import argparse
+import http.server
+import socketserver
+import threading
+import time
+
+
+class Stats:
+    lock = threading.Lock()
+    requests = 0
+    connections = 0
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # send headers and body in one segment, avoids delayed ack stalls
+    wbufsize = -1
+
+    def setup(self):
+        time.sleep(self.server.latency / 1000)
+        with Stats.lock:
+            Stats.connections += 1
+        super().setup()
+        self.request.settimeout(self.server.idle)
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        if length:
+            self.rfile.read(length)
+        with Stats.lock:
+            Stats.requests += 1
+        body = b'{"version":"0.3","rows":1}'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--latency", type=float, default=0, help="ms per new connection")
+    parser.add_argument("--idle", type=float, default=5, help="s until idle connections are closed")
+    parser.add_argument("--interval", type=float, default=10, help="s between reports")
+    args = parser.parse_args()
+
+    server = Server(("", args.port), Handler)
+    server.latency = args.latency
+    server.idle = args.idle
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    while True:
+        time.sleep(args.interval)
+        with Stats.lock:
+            requests, connections = Stats.requests, Stats.connections
+            Stats.requests = Stats.connections = 0
+        if requests:
+            print("%d requests, %d connections, %.2f requests per connection" % (requests, connections, requests / max(connections, 1)))
+
+
+if __name__ == "__main__":
+    main()
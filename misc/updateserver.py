@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""
+Minimal firmware update server
+
+Compresses a firmware image, writes the signed update manifest and serves
+the current directory. The manifest is signed with an RSA key whose public
+part is compiled in as UPDATE_PUBLIC_KEY:
+
+    openssl genrsa -out update.key 2048
+    openssl rsa -in update.key -pubout
+    misc/updateserver.py .pioenvs/esp8266/firmware.bin 0.4.1 --key update.key --window 600
+"""
+
+import argparse
+import gzip
+import hashlib
+import http.server
+import json
+import os
+import subprocess
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("firmware", help="firmware .bin")
+    parser.add_argument("version")
+    parser.add_argument("--key", required=True, help="RSA private key (PEM) signing the manifest")
+    parser.add_argument("--platform", default="esp8266", choices=["esp8266", "esp32"])
+    parser.add_argument("--window", type=int, default=3600, help="rollout window in s")
+    parser.add_argument("--port", type=int, default=8000)
+    args = parser.parse_args()
+
+    with open(args.firmware, "rb") as f:
+        data = f.read()
+
+    # only the esp8266 bootloader unpacks compressed images
+    image = "vzero-%s-%s.bin" % (args.platform, args.version)
+    if args.platform == "esp8266":
+        image += ".gz"
+        data = gzip.compress(data, 9)
+    with open(image, "wb") as f:
+        f.write(data)
+
+    # RSA PKCS#1 v1.5 signature over SHA-256 of version, image and image hash
+    sha256 = hashlib.sha256(data).hexdigest()
+    message = "%s\n%s\n%s" % (args.version, image, sha256)
+    signature = subprocess.run(["openssl", "dgst", "-sha256", "-sign", args.key],
+                               input=message.encode(), stdout=subprocess.PIPE, check=True).stdout
+
+    manifest = {
+        "version": args.version,
+        "image": image,
+        "sha256": sha256,
+        "signature": signature.hex(),
+        "window": args.window,
+    }
+    with open(args.platform + ".json", "w") as f:
+        json.dump(manifest, f)
+    print("%s: %d bytes, manifest %s.json" % (image, len(data), args.platform))
+
+    server = http.server.HTTPServer(("", args.port), http.server.SimpleHTTPRequestHandler)
+    print("serving %s on port %d" % (os.getcwd(), args.port))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
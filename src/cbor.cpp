@@ -0,0 +1,132 @@
+/**
+ * CBOR encoder
+ */
+
+#include "cbor.h"
+
+
+// major types
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+
+// simple values
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT32 0xfa
+#define CBOR_FLOAT64 0xfb
+
+
+/**
+ * Type byte with shortest argument encoding
+ */
+size_t writeHead(Print& out, uint8_t major, uint64_t arg)
+{
+  major <<= 5;
+  if (arg < 24)
+    return out.write(major | arg);
+
+  uint8_t buf[9];
+  uint8_t len;
+  if (arg <= 0xff) {
+    buf[0] = major | 24;
+    len = 1;
+  }
+  else if (arg <= 0xffff) {
+    buf[0] = major | 25;
+    len = 2;
+  }
+  else if (arg <= 0xffffffff) {
+    buf[0] = major | 26;
+    len = 4;
+  }
+  else {
+    buf[0] = major | 27;
+    len = 8;
+  }
+  // big endian
+  for (uint8_t i=0; i<len; i++)
+    buf[len - i] = arg >> (8 * i);
+  return out.write(buf, len + 1);
+}
+
+size_t writeText(Print& out, const char* str)
+{
+  if (str == NULL)
+    return out.write(CBOR_NULL);
+  size_t len = strlen(str);
+  return writeHead(out, CBOR_TEXT, len) + out.write((const uint8_t*)str, len);
+}
+
+/**
+ * Single precision if lossless, double precision otherwise
+ */
+size_t writeFloat(Print& out, double val)
+{
+  uint8_t buf[9];
+  uint8_t len;
+  uint64_t bits;
+  float single = val;
+  if (single == val) {
+    uint32_t bits32;
+    memcpy(&bits32, &single, sizeof(bits32));
+    bits = bits32;
+    buf[0] = CBOR_FLOAT32;
+    len = 4;
+  }
+  else {
+    memcpy(&bits, &val, sizeof(bits));
+    buf[0] = CBOR_FLOAT64;
+    len = 8;
+  }
+  // big endian
+  for (uint8_t i=0; i<len; i++)
+    buf[len - i] = bits >> (8 * i);
+  return out.write(buf, len + 1);
+}
+
+size_t cbor_write(Print& out, JsonVariant value)
+{
+  if (value.is<JsonObject>()) {
+    JsonObject& obj = value.as<JsonObject&>();
+    size_t len = writeHead(out, CBOR_MAP, obj.size());
+    for (JsonPair& pair : obj) {
+      len += writeText(out, pair.key);
+      len += cbor_write(out, pair.value);
+    }
+    return len;
+  }
+
+  if (value.is<JsonArray>()) {
+    JsonArray& arr = value.as<JsonArray&>();
+    size_t len = writeHead(out, CBOR_ARRAY, arr.size());
+    for (JsonVariant& item : arr) {
+      len += cbor_write(out, item);
+    }
+    return len;
+  }
+
+  if (value.is<const char*>())
+    return writeText(out, value.as<const char*>());
+
+  if (value.is<bool>())
+    return out.write(value.as<bool>() ? CBOR_TRUE : CBOR_FALSE);
+
+  // integers before floats - integers also satisfy is<double>()
+  if (value.is<long>()) {
+    // sign from double, integer storage may be signed or unsigned
+    if (value.as<double>() < 0)
+      return writeHead(out, CBOR_NEGINT, -1 - value.as<long long>());
+    return writeHead(out, CBOR_UINT, value.as<unsigned long long>());
+  }
+
+  if (value.is<double>()) {
+    double val = value.as<double>();
+    return isnan(val) ? out.write(CBOR_NULL) : writeFloat(out, val);
+  }
+
+  return out.write(CBOR_NULL);
+}
@@ -0,0 +1,24 @@
+/**
+ * CBOR encoder
+ *
+ * Writes an ArduinoJson tree as CBOR (RFC 7049) directly to a Print
+ * without intermediate buffer. Floats are encoded as single precision
+ * unless that loses precision. Integers are encoded up to 64 bit, which
+ * requires ARDUINOJSON_USE_LONG_LONG.
+ */
+
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <Arduino.h>
+#include "config.h"
+#include <ArduinoJson.h>
+
+#define CONTENT_TYPE_CBOR "application/cbor"
+
+/**
+ * Encode value, returns number of bytes written
+ */
+size_t cbor_write(Print& out, JsonVariant value);
+
+#endif
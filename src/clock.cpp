@@ -0,0 +1,68 @@
+/**
+ * Wall clock
+ */
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "clock.h"
+#include "planner.h"
+
+
+#define EPOCH_VALID 1500000000 // earliest plausible time
+
+static bool _started = false;
+static bool _aligned = false;
+static uint32_t _syncMillis = 0; // millis() at first sync
+static uint32_t _phase = 0;
+
+
+void clock_start()
+{
+  if (_started)
+    return;
+  _started = true;
+
+  DEBUG_MSG(CLOCK, "sntp server %s\n", g_ntpServer.c_str());
+  configTime(0, 0, g_ntpServer.c_str());
+}
+
+bool clock_synced()
+{
+  return time(NULL) > EPOCH_VALID;
+}
+
+uint64_t clock_epochMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  if (tv.tv_sec < EPOCH_VALID)
+    return 0;
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+void clock_loop()
+{
+  if (!_started || _aligned || !clock_synced())
+    return;
+
+  _aligned = true;
+  _syncMillis = millis();
+  DEBUG_MSG(CLOCK, "synchronized after %ums\n", _syncMillis);
+
+#ifdef CLOCK_ALIGN
+  // align cycle clock to time of day
+  _phase = planner_align(clock_epochMs() % (24 * 3600 * 1000ULL));
+  DEBUG_MSG(CLOCK, "cycle clock phase %ums\n", _phase);
+#endif
+}
+
+void clock_getJson(JsonObject* json)
+{
+  (*json)[F("synced")] = clock_synced();
+  if (!clock_synced())
+    return;
+  (*json)[F("epoch")] = (uint32_t)time(NULL);
+  (*json)[F("syncms")] = _syncMillis;
+  (*json)[F("phase")] = _phase;
+}
@@ -0,0 +1,42 @@
+/**
+ * Wall clock
+ *
+ * Synchronizes system time via SNTP and provides millisecond epoch
+ * timestamps for readings. Once synchronized the planner's cycle clock
+ * is aligned to wall-clock time so that readings of all devices using
+ * the same period coincide.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define CLOCK "clock"	// module name
+
+/**
+ * Start SNTP time sync
+ */
+void clock_start();
+
+/**
+ * Detect synchronization and align cycle clock, call from loop()
+ */
+void clock_loop();
+
+/**
+ * True if wall clock has been synchronized
+ */
+bool clock_synced();
+
+/**
+ * Milliseconds since epoch, 0 if not synchronized
+ */
+uint64_t clock_epochMs();
+
+void clock_getJson(JsonObject* json);
+
+#endif
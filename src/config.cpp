@@ -15,9 +15,12 @@
 #include <MD5Builder.h>
 #include <WString.h>
 #include <FS.h>
+#include "config.h"
+
 #include <ArduinoJson.h>
 
-#include "config.h"
+#include "plugins/Plugin.h"
+#include "tasks.h"
 
 #ifdef PLUGIN_ONEWIRE
 #include "plugins/OneWirePlugin.h"
@@ -35,56 +38,84 @@
 #include "plugins/WifiPlugin.h"
 #endif
 
+#ifdef PLUGIN_S0
+#include "plugins/S0Plugin.h"
+#endif
+
+#ifdef PLUGIN_SIMULATED
+#include "plugins/SimulatedPlugin.h"
+#endif
+
+#ifdef STATIC_PLUGINS
+#include "plugins/StaticRegistry.h"
+#endif
+
 // default AP SSID
 const char* ap_default_ssid = "VZERO";
 
+// compiled plugins, enabled by default unless configured in config.json
+PluginConfig g_plugins[] = {
+#ifdef PLUGIN_ONEWIRE
+  { "1wire", true, ONEWIRE_PIN, 0 },
+#endif
+#ifdef PLUGIN_DHT
+  { "dht", true, DHT_PIN, DHT_TYPE },
+#endif
+#ifdef PLUGIN_ANALOG
+  { "analog", true, -1, 0 },
+#endif
+#ifdef PLUGIN_WIFI
+  { "wifi", true, -1, 0 },
+#endif
+#ifdef PLUGIN_S0
+  { "s0", false, S0_PIN, 0 },
+#endif
+#ifdef PLUGIN_SIMULATED
+  { "sim", true, -1, 0 },
+#endif
+};
+const uint8_t g_pluginCount = sizeof(g_plugins) / sizeof(g_plugins[0]);
+
+#ifdef PLUGIN_SIMULATED
+SimulatedConfig g_simulated = { SIMULATED_SENSORS, SIMULATED_LATENCY, GENERATORS_ALL };
+#endif
+
 // global vars
 #ifdef ESP8266
 rst_info* g_resetInfo;
 #endif
 String net_hostname = "vzero";
 uint32_t g_minFreeHeap = -1;
+uint32_t g_pluginCycles = 0;
 
 // global settings
 String g_ssid = "";
 String g_pass = "";
 String g_middleware = "";
+uint8_t g_transport = TRANSPORT_HTTP;
+String g_mqttHost = "";
+uint16_t g_mqttPort = MQTT_PORT;
+uint8_t g_mqttQos = 0;
+bool g_mqttRetain = true;
+String g_mqttUser = "";
+String g_mqttPass = "";
+String g_syslogHost = "";
+String g_ntpServer = NTP_SERVER;
+String g_updateServer = "";
+uint32_t g_wifiRestartTimeout = WIFI_RESTART_TIMEOUT;
 
 
-#ifdef DEBUG
-void debug_plain(const char *msg) {
-  ets_printf(msg);
-}
-
-/**
- * Verbose debug output
- */
-void debug_message(const char *module, const char *format, ...) {
-  #define BUFFER_SIZE 150
-  char buf[BUFFER_SIZE];
-  ets_printf("%08d [%-6s] ", millis(), module);
-  // snprintf(buf, BUFFER_SIZE, "%6.3f [%-6s] ", millis()/1000.0, module);
-
-  va_list args;
-  va_start(args, format);
-  vsnprintf(buf, BUFFER_SIZE, format, args);
-  ets_printf(buf);
-  va_end(args);
-
-  if (ESP.getFreeHeap() < g_minFreeHeap) {
-    g_minFreeHeap = ESP.getFreeHeap();
-  }
-}
-#endif
-
 long getChipId()
 {
 #ifdef ESP8266
   return ESP.getChipId();
 #endif
 #ifdef ESP32
-  long chipId;
-  ESP.getEfuseMac();
+  // last three mac bytes like the ESP8266 chip id
+  uint64_t mac = ESP.getEfuseMac();
+  long chipId = 0;
+  for (uint8_t i=0; i<3; i++)
+    chipId |= ((mac >> (40 - 8 * i)) & 0xff) << (8 * i);
   return chipId;
 #endif
 }
@@ -123,6 +154,59 @@ String getHash()
   return md5.toString();
 }
 
+/**
+ * Find plugin configuration by name
+ */
+PluginConfig* getPluginConfig(const char* name)
+{
+  for (uint8_t i=0; i<g_pluginCount; i++) {
+    if (strcmp(g_plugins[i].name, name) == 0)
+      return &g_plugins[i];
+  }
+  return NULL;
+}
+
+#ifdef PLUGIN_SIMULATED
+/**
+ * Simulated plugin sensor count, latency and generator names
+ */
+static void loadSimulatedConfig(JsonObject& json)
+{
+  if (json.containsKey("sensors"))
+    g_simulated.sensors = constrain(json["sensors"].as<long>(), 1, SIMULATED_MAX_SENSORS);
+  if (json.containsKey("latency"))
+    g_simulated.latency = constrain(json["latency"].as<long>(), 0, SIMULATED_MAX_LATENCY);
+
+  JsonArray& generators = json["generators"].as<JsonArray&>();
+  if (!generators.success())
+    return;
+  uint8_t mask = 0;
+  for (size_t i=0; i<generators.size(); i++) {
+    const char* name = generators[i];
+    int8_t generator = SimulatedPlugin::getGenerator(name);
+    if (generator >= 0)
+      mask |= 1 << generator;
+    else
+      WARN_MSG(CORE, "unknown generator %s\n", (name) ? name : "");
+  }
+  g_simulated.generators = (mask) ? mask : GENERATORS_ALL;
+}
+
+static void saveSimulatedConfig(JsonObject& json)
+{
+  json["sensors"] = g_simulated.sensors;
+  if (g_simulated.latency != SIMULATED_LATENCY)
+    json["latency"] = g_simulated.latency;
+  if (g_simulated.generators != GENERATORS_ALL) {
+    JsonArray& generators = json.createNestedArray("generators");
+    for (uint8_t generator=0; generator<GENERATORS; generator++) {
+      if (g_simulated.generators & (1 << generator))
+        generators.add(SimulatedPlugin::getGeneratorName(generator));
+    }
+  }
+}
+#endif
+
 /**
  * Load config
  */
@@ -131,7 +215,7 @@ bool loadConfig()
   DEBUG_MSG(CORE, "loading config\n");
   File configFile = SPIFFS.open(F("/config.json"), "r");
   if (!configFile) {
-    DEBUG_MSG(CORE, "open config failed");
+    WARN_MSG(CORE, "open config failed\n");
     return false;
   }
 
@@ -141,18 +225,85 @@ bool loadConfig()
   configFile.close();
 
   String arg;
-  StaticJsonBuffer<512> jsonBuffer;
+  DynamicJsonBuffer jsonBuffer;
   JsonObject& json = jsonBuffer.parseObject(buf.get());
+  if (!json.success()) {
+    ERROR_MSG(CORE, "parse config failed\n");
+    return false;
+  }
   arg = json["ssid"].as<char*>();
   if (arg) g_ssid = arg;
   arg = json["password"].as<char*>();
   if (arg) g_pass = arg;
   arg = json["middleware"].as<char*>();
   if (arg) g_middleware = arg;
+  arg = json["syslog"].as<char*>();
+  if (arg) g_syslogHost = arg;
+  arg = json["ntp"].as<char*>();
+  if (arg) g_ntpServer = arg;
+  arg = json["update"].as<char*>();
+  if (arg) g_updateServer = arg;
+  if (g_updateServer.endsWith("/"))
+    g_updateServer.remove(g_updateServer.length() - 1);
+  if (json.containsKey("wifirestart")) {
+    long timeout = json["wifirestart"];
+    g_wifiRestartTimeout = (timeout == 0) ? 0 : constrain(timeout, WIFI_RESTART_MIN, WIFI_RESTART_MAX);
+  }
+
+  // mqtt transport
+  arg = json["transport"].as<char*>();
+  g_transport = (arg == "mqtt") ? TRANSPORT_MQTT : TRANSPORT_HTTP;
+  JsonObject& mqtt = json["mqtt"].as<JsonObject&>();
+  if (mqtt.success()) {
+    arg = mqtt["host"].as<char*>();
+    if (arg) g_mqttHost = arg;
+    if (mqtt.containsKey("port")) g_mqttPort = mqtt["port"];
+    if (mqtt.containsKey("qos")) g_mqttQos = min((uint8_t)mqtt["qos"], (uint8_t)1);
+    if (mqtt.containsKey("retain")) g_mqttRetain = mqtt["retain"];
+    arg = mqtt["user"].as<char*>();
+    if (arg) g_mqttUser = arg;
+    arg = mqtt["password"].as<char*>();
+    if (arg) g_mqttPass = arg;
+  }
+  // without broker readings would never leave the device
+  if (g_transport == TRANSPORT_MQTT && g_mqttHost == "") {
+    WARN_MSG(CORE, "mqtt host missing, using http\n");
+    g_transport = TRANSPORT_HTTP;
+  }
+
+  // plugin selection - only listed plugins are enabled
+  JsonObject& plugins = json["plugins"].as<JsonObject&>();
+  if (plugins.success()) {
+    for (uint8_t i=0; i<g_pluginCount; i++) {
+      JsonObject& plugin = plugins[g_plugins[i].name].as<JsonObject&>();
+      g_plugins[i].enabled = plugin.success();
+      if (!g_plugins[i].enabled)
+        continue;
+      if (plugin.containsKey("pin")) g_plugins[i].pin = plugin["pin"];
+      if (plugin.containsKey("type")) g_plugins[i].type = plugin["type"];
+    }
+#ifdef PLUGIN_SIMULATED
+    JsonObject& sim = plugins["sim"].as<JsonObject&>();
+    if (sim.success())
+      loadSimulatedConfig(sim);
+#endif
+  }
+
+#ifdef PLUGIN_S0
+  // invalid pins would leave the plugin without interrupt
+  PluginConfig* s0 = getPluginConfig("s0");
+  if (s0->enabled && !S0Plugin::isSupportedPin(s0->pin)) {
+    WARN_MSG(CORE, "s0 pin %d not supported, plugin disabled\n", s0->pin);
+    s0->enabled = false;
+    s0->pin = S0_PIN;
+  }
+#endif
 
   DEBUG_MSG(CORE, "ssid:       %s\n", g_ssid.c_str());
   // DEBUG_MSG(CORE, "config psk:    %s\n", g_pass.c_str());
   DEBUG_MSG(CORE, "middleware: %s\n", g_middleware.c_str());
+  if (g_transport == TRANSPORT_MQTT)
+    DEBUG_MSG(CORE, "mqtt:       %s:%d\n", g_mqttHost.c_str(), g_mqttPort);
 
   return true;
 }
@@ -164,15 +315,52 @@ bool saveConfig()
 {
   File configFile = SPIFFS.open(F("/config.json"), "w");
   if (!configFile) {
-    DEBUG_MSG(CORE, "save config failed");
+    ERROR_MSG(CORE, "save config failed\n");
     return false;
   }
 
-  StaticJsonBuffer<512> jsonBuffer;
+  DynamicJsonBuffer jsonBuffer;
   JsonObject& json = jsonBuffer.createObject();
   json["ssid"] = g_ssid;
   json["password"] = g_pass;
   json["middleware"] = g_middleware;
+  if (g_syslogHost != "")
+    json["syslog"] = g_syslogHost;
+  if (g_ntpServer != NTP_SERVER)
+    json["ntp"] = g_ntpServer;
+  if (g_updateServer != "")
+    json["update"] = g_updateServer;
+  if (g_wifiRestartTimeout != WIFI_RESTART_TIMEOUT)
+    json["wifirestart"] = g_wifiRestartTimeout;
+
+  if (g_transport == TRANSPORT_MQTT)
+    json["transport"] = "mqtt";
+  if (g_mqttHost != "") {
+    JsonObject& mqtt = json.createNestedObject("mqtt");
+    mqtt["host"] = g_mqttHost;
+    mqtt["port"] = g_mqttPort;
+    mqtt["qos"] = g_mqttQos;
+    mqtt["retain"] = g_mqttRetain;
+    if (g_mqttUser != "") {
+      mqtt["user"] = g_mqttUser;
+      mqtt["password"] = g_mqttPass;
+    }
+  }
+
+  JsonObject& plugins = json.createNestedObject("plugins");
+  for (uint8_t i=0; i<g_pluginCount; i++) {
+    if (!g_plugins[i].enabled)
+      continue;
+    JsonObject& plugin = plugins.createNestedObject(g_plugins[i].name);
+    if (g_plugins[i].pin >= 0)
+      plugin["pin"] = g_plugins[i].pin;
+    if (g_plugins[i].type > 0)
+      plugin["type"] = g_plugins[i].type;
+  }
+#ifdef PLUGIN_SIMULATED
+  if (plugins.containsKey("sim"))
+    saveSimulatedConfig(plugins["sim"].as<JsonObject&>());
+#endif
 
   json.printTo(configFile);
   configFile.close();
@@ -180,26 +368,155 @@ bool saveConfig()
   return true;
 }
 
+static bool _configDirty = false;
+static uint32_t _configChanged = 0;
+
+/**
+ * Record config change, global for config.json
+ */
+void configChanged(bool global)
+{
+  if (global)
+    _configDirty = true;
+  _configChanged = millis() | 1; // 0 means clean
+}
+
+/**
+ * Write changed config.json and plugin configs
+ */
+void flushConfig(bool force)
+{
+  if (_configChanged == 0)
+    return;
+  if (!force && millis() - _configChanged < (CONFIG_QUIET_PERIOD))
+    return;
+
+  DEBUG_MSG(CORE, "flushing config\n");
+  _configChanged = 0;
+  if (_configDirty) {
+    _configDirty = false;
+    saveConfig();
+  }
+  Plugin::each([](Plugin* plugin) {
+    plugin->persist();
+  });
+}
+
+#ifdef STATIC_PLUGINS
+/**
+ * Static plugin construction, pins from config.json. Plugins disabled in
+ * config.json leave their slot empty.
+ */
+static PluginConfig* getEnabledConfig(const char* name)
+{
+  PluginConfig* config = getPluginConfig(name);
+  if (!config->enabled)
+    return NULL;
+  DEBUG_MSG(CORE, "plugin %s pin %d\n", config->name, config->pin);
+  return config;
+}
+
+#ifdef PLUGIN_ONEWIRE
+template<> OneWirePlugin* pluginCreate<OneWirePlugin>(void* storage) {
+  PluginConfig* config = getEnabledConfig("1wire");
+  return (config) ? new(storage) OneWirePlugin(config->pin) : NULL;
+}
+#endif
+#ifdef PLUGIN_DHT
+template<> DHTPlugin* pluginCreate<DHTPlugin>(void* storage) {
+  PluginConfig* config = getEnabledConfig("dht");
+  return (config) ? new(storage) DHTPlugin(config->pin, config->type) : NULL;
+}
+#endif
+#ifdef PLUGIN_ANALOG
+template<> AnalogPlugin* pluginCreate<AnalogPlugin>(void* storage) {
+  return (getEnabledConfig("analog")) ? new(storage) AnalogPlugin() : NULL;
+}
+#endif
+#ifdef PLUGIN_WIFI
+template<> WifiPlugin* pluginCreate<WifiPlugin>(void* storage) {
+  return (getEnabledConfig("wifi")) ? new(storage) WifiPlugin() : NULL;
+}
+#endif
+#ifdef PLUGIN_S0
+template<> S0Plugin* pluginCreate<S0Plugin>(void* storage) {
+  PluginConfig* config = getEnabledConfig("s0");
+  return (config) ? new(storage) S0Plugin(config->pin) : NULL;
+}
+#endif
+#ifdef PLUGIN_SIMULATED
+template<> SimulatedPlugin* pluginCreate<SimulatedPlugin>(void* storage) {
+  PluginConfig* config = getEnabledConfig("sim");
+  return (config) ? new(storage) SimulatedPlugin(g_simulated.sensors, g_simulated.latency, g_simulated.generators) : NULL;
+}
+#endif
+
+typedef StaticRegistry<STATIC_PLUGINS> StaticPlugins;
+
+void startPlugins()
+{
+  DEBUG_MSG(CORE, "starting static plugins\n");
+  StaticPlugins::begin();
+}
+
+void loopPlugins()
+{
+  StaticPlugins::loop();
+}
+
+#else
 /**
  * Start enabled plugins
  */
 void startPlugins()
 {
   DEBUG_MSG(CORE, "starting plugins\n");
+  for (uint8_t i=0; i<g_pluginCount; i++) {
+    PluginConfig* config = &g_plugins[i];
+    if (!config->enabled)
+      continue;
+    DEBUG_MSG(CORE, "plugin %s pin %d\n", config->name, config->pin);
 #ifdef PLUGIN_ONEWIRE
-  new OneWirePlugin(ONEWIRE_PIN);
+    if (strcmp(config->name, "1wire") == 0)
+      new OneWirePlugin(config->pin);
 #endif
 #ifdef PLUGIN_DHT
-  new DHTPlugin(DHT_PIN, DHT_TYPE);
+    if (strcmp(config->name, "dht") == 0)
+      new DHTPlugin(config->pin, config->type);
 #endif
 #ifdef PLUGIN_ANALOG
-  new AnalogPlugin();
+    if (strcmp(config->name, "analog") == 0)
+      new AnalogPlugin();
 #endif
 #ifdef PLUGIN_WIFI
-  new WifiPlugin();
+    if (strcmp(config->name, "wifi") == 0)
+      new WifiPlugin();
+#endif
+#ifdef PLUGIN_S0
+    if (strcmp(config->name, "s0") == 0)
+      new S0Plugin(config->pin);
+#endif
+#ifdef PLUGIN_SIMULATED
+    if (strcmp(config->name, "sim") == 0)
+      new SimulatedPlugin(g_simulated.sensors, g_simulated.latency, g_simulated.generators);
 #endif
+  }
 }
 
+/**
+ * Call plugin's loop method
+ */
+void loopPlugins()
+{
+  Plugin::each([](Plugin* plugin) {
+    if (tasks_owns(plugin))
+      return;
+    plugin->loop();
+    yield();
+  });
+}
+#endif
+
 #ifdef ESP8266
 int getResetReason(int core)
 {
@@ -2,9 +2,17 @@
  * Config file
  */
 
+#ifndef CONFIG_H
+#define CONFIG_H
+
 #include <WString.h>
 #include <MD5Builder.h>
 
+// 64 bit integers for ms timestamps, before ArduinoJson is first included
+#ifndef ARDUINOJSON_USE_LONG_LONG
+#define ARDUINOJSON_USE_LONG_LONG 1
+#endif
+
 #ifdef ESP8266
 extern "C" {
   #include <user_interface.h>
@@ -17,16 +25,22 @@ extern "C" {
  */
 #define DEBUG
 
+// log buffer, messages above LOG_LEVEL are not compiled
 #ifdef DEBUG
-void debug_plain(const char *msg);
-void debug_message(const char *module, const char *format, ...);
-
-#define DEBUG_PLAIN(msg) debug_plain(msg)
-#define DEBUG_MSG(module, format, ...) debug_message(module, format, ##__VA_ARGS__ )
+#define LOG_LEVEL LOG_DEBUG
 #else
-#define DEBUG_PLAIN(msg)
-#define DEBUG_MSG(...) if (ESP.getFreeHeap() < g_minFreeHeap) { g_minFreeHeap = ESP.getFreeHeap(); }
+#define LOG_LEVEL LOG_WARN
 #endif
+#define LOG_BUFFER_SIZE 2048
+// #define LOG_SYSLOG // forward log to syslog host from config.json
+
+#include "log.h"
+
+#define DEBUG_PLAIN(msg) log_plain(msg)
+#define ERROR_MSG(module, format, ...) LOG_MSG(LOG_ERROR, module, format, ##__VA_ARGS__)
+#define WARN_MSG(module, format, ...) LOG_MSG(LOG_WARN, module, format, ##__VA_ARGS__)
+#define INFO_MSG(module, format, ...) LOG_MSG(LOG_INFO, module, format, ##__VA_ARGS__)
+#define DEBUG_MSG(module, format, ...) LOG_MSG(LOG_DEBUG, module, format, ##__VA_ARGS__)
 
 #ifdef ESP8266
 #define PANIC(...) panic()
@@ -44,13 +58,44 @@ void debug_message(const char *module, const char *format, ...);
 #define PLUGIN_DHT
 #define PLUGIN_ANALOG
 #define PLUGIN_WIFI
+#define PLUGIN_S0
+// #define PLUGIN_SIMULATED  // synthetic sensors for load testing
 
 // #define SPIFFS_EDITOR
 
-// settings
+// fixed plugin set in static memory with non-virtual loop dispatch,
+// enables all listed plugins regardless of config.json
+// #define STATIC_PLUGINS OneWirePlugin, DHTPlugin, AnalogPlugin, WifiPlugin
+
+// default settings, plugins and pins can be selected in config.json
 #define ONEWIRE_PIN 14
 #define DHT_PIN 14
 #define DHT_TYPE DHT11
+#define S0_PIN 12
+#define SIMULATED_SENSORS 16
+#define SIMULATED_MAX_SENSORS 200  // bounded by heap, ~100 bytes per sensor
+#define SIMULATED_LATENCY 100   // ms
+#define SIMULATED_MAX_LATENCY 10000
+
+// high rate A0 sampling (rms, mean, peak sensors), ESP8266 samples in bursts
+// #define ANALOG_SAMPLER
+#define ANALOG_SAMPLE_RATE 2000 // Hz
+#define ANALOG_WINDOW 200       // ms
+
+/*
+ * Upload coordination
+ */
+#define UPLOAD_WINDOW 10 * 1000       // readings are uploaded together at aligned boundaries
+#define UPLOAD_MAX_LATENCY 10 * 1000  // max delay of a reading before upload
+
+/*
+ * Sensor history
+ */
+#define HISTORY_RAM_SAMPLES 32        // recent samples per sensor kept in RAM
+#define HISTORY_BLOCK_SAMPLES 16      // samples per compressed flash block
+#define HISTORY_MAX_SERIES 12         // max number of sensors with history
+#define HISTORY_FLASH_BYTES 32 * 1024 // flash budget per sensor
+#define HISTORY_SCALE 100             // fixed point scale
 
 /*
  * Sleep mode
@@ -65,6 +110,28 @@ void debug_message(const char *module, const char *format, ...);
 // client disconnect timeout
 #define WIFI_CLIENT_TIMEOUT 120 * 1000
 
+// energy estimates
+#define ENERGY_AWAKE_MA 80            // average current while awake
+#define ENERGY_SLEEP_UA 20            // deep sleep current
+#define ENERGY_WIFI_CONNECT_MS 1500   // reconnect after deep sleep
+#define BATTERY_CAPACITY_MAH 2000
+
+/*
+ * MQTT transport
+ */
+#define TRANSPORT_HTTP 0
+#define TRANSPORT_MQTT 1
+#define MQTT_PORT 1883
+#define MQTT_KEEPALIVE 60                 // s
+#define MQTT_RECONNECT_DELAY 1000         // initial reconnect delay
+#define MQTT_RECONNECT_MAX_DELAY 60 * 1000
+
+/*
+ * Middleware connection
+ */
+#define MIDDLEWARE_KEEPALIVE            // reuse connection across uploads
+#define MIDDLEWARE_TIMEOUT 5000
+
 // memory management
 #define HTTP_MIN_HEAP 4096
 
@@ -72,7 +139,35 @@ void debug_message(const char *module, const char *format, ...);
 #define CORE "core"		// module name
 #define BUILD "0.4.0"   // version
 #define WIFI_CONNECT_TIMEOUT 10000
+#define WIFI_BACKOFF_MIN 1000
+#define WIFI_BACKOFF_MAX (60 * 1000)
+#define WIFI_RESTART_TIMEOUT (30 * 60)  // restart after outage in s, 0 disabled
+#define WIFI_RESTART_MIN 60             // s, bounds for config.json
+#define WIFI_RESTART_MAX 86400
 #define OPTIMISTIC_YIELD_TIME 10000
+// main loop delay - limits the plugin sample rate
+#define LOOP_DELAY 100
+// ESP32: sample and upload in tasks on separate cores
+// #define ESP32_TASKS
+
+// sntp time sync, server can be set in config.json
+#define NTP_SERVER "pool.ntp.org"
+#define CLOCK_ALIGN // align measurements to wall-clock boundaries
+#define CONFIG_QUIET_PERIOD 2 * 1000  // delay config writes until changes settled
+
+// pull firmware updates, server can be set in config.json
+#define UPDATE_CHECK_DELAY (60 * 1000)          // first check after boot
+#define UPDATE_CHECK_INTERVAL (6 * 3600 * 1000)
+#define UPDATE_WINDOW 3600        // default rollout window in s
+#define UPDATE_TIMEOUT 10000                    // per read
+#define UPDATE_INSTALL_TIMEOUT (5 * 60 * 1000)  // whole download, blocks the loop
+#define UPDATE_MANIFEST_SIZE 1536
+#define UPDATE_BUFFER_SIZE 512
+// images are written to flash as downloaded, not inflated on the fly. gzip
+// images only work on ESP8266 where the bootloader unpacks them
+// RSA public key (PEM) verifying the manifest signature, pull updates are
+// disabled without it
+// #define UPDATE_PUBLIC_KEY "-----BEGIN PUBLIC KEY-----\n...\n-----END PUBLIC KEY-----\n"
 
 // ESP32 specifics
 #ifdef ESP32
@@ -93,11 +188,45 @@ extern rst_info* g_resetInfo;
 #endif
 extern String net_hostname;
 extern uint32_t g_minFreeHeap;
+extern uint32_t g_pluginCycles;
 
 // global settings
 extern String g_ssid;
 extern String g_pass;
 extern String g_middleware;
+extern uint8_t g_transport;
+extern String g_mqttHost;
+extern uint16_t g_mqttPort;
+extern uint8_t g_mqttQos;
+extern bool g_mqttRetain;
+extern String g_mqttUser;
+extern String g_mqttPass;
+extern String g_syslogHost;
+extern String g_ntpServer;
+extern String g_updateServer;
+extern uint32_t g_wifiRestartTimeout;
+
+// plugin selection
+struct PluginConfig {
+  const char* name;
+  bool enabled;
+  int8_t pin;
+  uint8_t type;
+};
+
+extern PluginConfig g_plugins[];
+extern const uint8_t g_pluginCount;
+
+#ifdef PLUGIN_SIMULATED
+// simulated plugin settings
+struct SimulatedConfig {
+  uint16_t sensors;
+  uint16_t latency;     // ms per read
+  uint8_t generators;   // bitmask of enabled generators
+};
+
+extern SimulatedConfig g_simulated;
+#endif
 
 
 /*
@@ -109,6 +238,7 @@ void validateFlash();
 #endif
 
 void startPlugins();
+void loopPlugins();
 
 long getChipId();
 
@@ -118,5 +248,14 @@ String getHash();
 bool loadConfig();
 bool saveConfig();
 
+/**
+ * Deferred config persistence - changes are written from loop() once no
+ * further change happened for CONFIG_QUIET_PERIOD or when forced
+ */
+void configChanged(bool global = false);
+void flushConfig(bool force = false);
+
 int getResetReason(int core);
 const char* getResetReasonStr(int core);
+
+#endif
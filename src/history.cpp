@@ -0,0 +1,421 @@
+/**
+ * Sensor history
+ */
+
+#ifdef ESP32
+#include <SPIFFS.h>
+#endif
+
+#include "history.h"
+#include "clock.h"
+#include "plugins/Plugin.h"
+
+
+#define BLOCK_MAGIC 0xB2     // 0xB1 blocks used seconds since boot
+#define BLOCK_HEADER_SIZE 10 // magic, count, ts, val
+#define VARINT_MAX_SIZE 5
+
+static HistorySeries* _series = NULL;
+static uint8_t _seriesCount = 0;
+static uint32_t _unsynced = 0;
+
+// ring position, log size and readers are shared with web server readers
+#ifdef ESP8266
+#define HISTORY_LOCK() uint32_t savedPS = xt_rsil(15)
+#define HISTORY_UNLOCK() xt_wsr_ps(savedPS)
+#endif
+#ifdef ESP32
+static portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+#define HISTORY_LOCK() portENTER_CRITICAL(&_mux)
+#define HISTORY_UNLOCK() portEXIT_CRITICAL(&_mux)
+#endif
+
+// benchmark
+static uint32_t _appends = 0;
+static uint32_t _appendUs = 0;
+static uint32_t _flushes = 0;
+static uint32_t _flushUs = 0;
+static uint32_t _flushBytes = 0;
+static uint32_t _flushSamples = 0;
+static uint32_t _queryUs = 0;
+static uint32_t _querySamples = 0;
+
+
+/*
+ * Encoding
+ */
+
+static uint8_t putVarint(uint8_t* buf, int32_t val) {
+  uint32_t zz = ((uint32_t)val << 1) ^ (val >> 31);
+  uint8_t len = 0;
+  while (zz >= 0x80) {
+    buf[len++] = (zz & 0x7F) | 0x80;
+    zz >>= 7;
+  }
+  buf[len++] = zz;
+  return len;
+}
+
+static bool getVarint(File& file, int32_t* val) {
+  uint32_t zz = 0;
+  for (uint8_t shift=0; shift<7*VARINT_MAX_SIZE; shift+=7) {
+    int c = file.read();
+    if (c < 0)
+      return false;
+    zz |= (uint32_t)(c & 0x7F) << shift;
+    if ((c & 0x80) == 0) {
+      *val = (zz >> 1) ^ -(int32_t)(zz & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*
+ * HistorySeries
+ */
+
+HistorySeries::HistorySeries(Plugin* plugin, int16_t sensor) : _plugin(plugin), _sensor(sensor), _next(NULL),
+  _head(0), _count(0), _unflushed(0), _flushedTs(0), _logSize(0), _readers(0)
+{
+  _samples = (HistorySample*)malloc(HISTORY_RAM_SAMPLES * sizeof(HistorySample));
+
+  // logs with timestamps since boot can't be merged, drop them
+  File log = SPIFFS.open(getFile(), "r");
+  if (log) {
+    _logSize = log.size();
+    bool valid = _logSize == 0 || log.peek() == BLOCK_MAGIC;
+    log.close();
+    if (!valid) {
+      DEBUG_MSG(HISTORY, "removing outdated %s\n", getFile().c_str());
+      SPIFFS.remove(getFile());
+      SPIFFS.remove(getFile(true));
+      _logSize = 0;
+    }
+  }
+}
+
+HistorySeries::~HistorySeries() {
+  free(_samples);
+}
+
+String HistorySeries::getName() {
+  char addr_c[20];
+  _plugin->getAddr(addr_c, _sensor);
+  return _plugin->getName() + "/" + addr_c;
+}
+
+String HistorySeries::getFile(bool rotated) {
+  char addr_c[20];
+  _plugin->getAddr(addr_c, _sensor);
+  String file = "/h/" + _plugin->getName() + "-" + addr_c;
+  if (rotated)
+    file += ".1";
+  return file;
+}
+
+void HistorySeries::append(uint32_t ts, float val) {
+  if (_samples == NULL)
+    return;
+
+  HISTORY_LOCK();
+  _samples[_head].ts = ts;
+  _samples[_head].val = lround(val * HISTORY_SCALE);
+  _head = (_head + 1) % HISTORY_RAM_SAMPLES;
+  if (_count < HISTORY_RAM_SAMPLES)
+    _count++;
+
+  // unflushed samples are only overwritten if flash writes fail
+  if (_unflushed < HISTORY_RAM_SAMPLES)
+    _unflushed++;
+  HISTORY_UNLOCK();
+
+  if (_unflushed >= HISTORY_BLOCK_SAMPLES)
+    flush();
+}
+
+/**
+ * Compress oldest unflushed block and append to flash log
+ */
+bool HistorySeries::flush() {
+  uint32_t start = micros();
+  uint8_t buf[BLOCK_HEADER_SIZE + 2 * VARINT_MAX_SIZE * HISTORY_BLOCK_SAMPLES];
+  uint16_t pos = (_head + HISTORY_RAM_SAMPLES - _unflushed) % HISTORY_RAM_SAMPLES;
+  HistorySample* sample = &_samples[pos];
+
+  buf[0] = BLOCK_MAGIC;
+  buf[1] = HISTORY_BLOCK_SAMPLES;
+  memcpy(&buf[2], &sample->ts, sizeof(sample->ts));
+  memcpy(&buf[6], &sample->val, sizeof(sample->val));
+  size_t len = BLOCK_HEADER_SIZE;
+
+  int32_t delta = 0;
+  HistorySample* last = sample;
+  for (uint8_t i=1; i<HISTORY_BLOCK_SAMPLES; i++) {
+    sample = &_samples[(pos + i) % HISTORY_RAM_SAMPLES];
+    int32_t tsDelta = sample->ts - last->ts;
+    len += putVarint(&buf[len], tsDelta - delta);
+    len += putVarint(&buf[len], sample->val - last->val);
+    delta = tsDelta;
+    last = sample;
+  }
+
+  // rotate log if flash budget exceeded
+  String file = getFile();
+  File log = SPIFFS.open(file, "a");
+  if (!log) {
+    ERROR_MSG(HISTORY, "failed to open %s\n", file.c_str());
+    return false;
+  }
+  if (log.size() + len > HISTORY_FLASH_BYTES / 2) {
+    log.close();
+    // open readers would lose their files, keep samples in ram meanwhile
+    HISTORY_LOCK();
+    uint8_t readers = _readers;
+    if (readers == 0)
+      _logSize = 0;
+    HISTORY_UNLOCK();
+    if (readers > 0) {
+      DEBUG_MSG(HISTORY, "rotation deferred\n");
+      return false;
+    }
+    SPIFFS.remove(getFile(true));
+    SPIFFS.rename(file, getFile(true));
+    log = SPIFFS.open(file, "a");
+    if (!log)
+      return false;
+  }
+
+  bool res = log.write(buf, len) == len;
+  size_t size = log.size();
+  log.close();
+
+  if (res) {
+    HISTORY_LOCK();
+    _unflushed -= HISTORY_BLOCK_SAMPLES;
+    _flushedTs = last->ts;
+    _logSize = size;
+    HISTORY_UNLOCK();
+  }
+
+  _flushes++;
+  _flushUs += micros() - start;
+  _flushBytes += len;
+  _flushSamples += HISTORY_BLOCK_SAMPLES;
+  return res;
+}
+
+
+/*
+ * HistoryReader
+ */
+
+HistoryReader::HistoryReader(HistorySeries* series, uint32_t from) : _series(series), _from(from),
+  _phase(0), _blockCount(0), _blockPos(0), _ramPos(0), _samples(0), _duration(0), _len(0), _pos(0)
+{
+  // later flushes are part of the ram snapshot
+  HISTORY_LOCK();
+  _series->_readers++;
+  _logSize = _series->_logSize;
+  _ramCount = _series->_unflushed;
+  for (uint16_t i=0; i<_ramCount; i++)
+    _ram[i] = _series->_samples[(_series->_head + HISTORY_RAM_SAMPLES - _ramCount + i) % HISTORY_RAM_SAMPLES];
+  HISTORY_UNLOCK();
+}
+
+HistoryReader::~HistoryReader() {
+  if (_file)
+    _file.close();
+  HISTORY_LOCK();
+  _series->_readers--;
+  HISTORY_UNLOCK();
+}
+
+/**
+ * Fill buffer with json array of [timestamp,value] pairs, returns 0 when done
+ */
+size_t HistoryReader::readJson(uint8_t* buffer, size_t maxLen) {
+  uint32_t start = micros();
+  size_t len = 0;
+
+  while (len < maxLen) {
+    if (_pos >= _len) {
+      HistorySample sample;
+      if (_phase == 5)
+        break;
+      _pos = 0;
+
+      if (_len == 0) {
+        _len = sprintf(_buf, "[");
+      }
+      else if (next(&sample)) {
+        char val_c[16];
+        dtostrf((float)sample.val / HISTORY_SCALE, -4, 2, val_c);
+        _len = sprintf(_buf, "%s[%u,%s]", (_samples++) ? "," : "", sample.ts, val_c);
+      }
+      else {
+        _len = sprintf(_buf, "]");
+        _phase = 5;
+      }
+    }
+
+    size_t chunk = min(maxLen - len, (size_t)(_len - _pos));
+    memcpy(&buffer[len], &_buf[_pos], chunk);
+    len += chunk;
+    _pos += chunk;
+  }
+
+  _duration += micros() - start;
+  if (len == 0)
+    history_queryDone(_duration, _samples);
+
+  return len;
+}
+
+bool HistoryReader::readBlock() {
+  _blockCount = _blockPos = 0;
+
+  // current log is read up to its size at open
+  if (_phase == 3 && _file.position() >= _logSize)
+    return false;
+
+  uint8_t header[BLOCK_HEADER_SIZE];
+  if (_file.read(header, BLOCK_HEADER_SIZE) != BLOCK_HEADER_SIZE || header[0] != BLOCK_MAGIC)
+    return false;
+
+  uint8_t count = min(header[1], (uint8_t)HISTORY_BLOCK_SAMPLES);
+  memcpy(&_block[0].ts, &header[2], sizeof(_block[0].ts));
+  memcpy(&_block[0].val, &header[6], sizeof(_block[0].val));
+
+  int32_t delta = 0;
+  for (uint8_t i=1; i<count; i++) {
+    int32_t dod, valDelta;
+    if (!getVarint(_file, &dod) || !getVarint(_file, &valDelta))
+      return false;
+    delta += dod;
+    _block[i].ts = _block[i-1].ts + delta;
+    _block[i].val = _block[i-1].val + valDelta;
+  }
+
+  _blockCount = count;
+  return true;
+}
+
+/**
+ * Get next sample (rotated log -> log -> ram)
+ */
+bool HistoryReader::next(HistorySample* sample) {
+  while (_phase < 4) {
+    switch (_phase) {
+      case 0:
+      case 2:
+        // open rotated log, then current log
+        _file = SPIFFS.open(_series->getFile(_phase == 0), "r");
+        _phase++;
+        if (!_file)
+          _phase++;
+        break;
+
+      case 1:
+      case 3:
+        if (_blockPos >= _blockCount && !readBlock()) {
+          _file.close();
+          _phase++;
+          if (_phase == 4)
+            _ramPos = 0;
+          break;
+        }
+        *sample = _block[_blockPos++];
+        if (sample->ts >= _from)
+          return true;
+        break;
+    }
+  }
+
+  // ram samples not yet in flash when opened
+  while (_ramPos < _ramCount) {
+    *sample = _ram[_ramPos++];
+    if (sample->ts >= _from)
+      return true;
+  }
+
+  return false;
+}
+
+
+/*
+ * Functions
+ */
+
+void history_append(Plugin* plugin, int16_t sensor, float val) {
+  if (isnan(val))
+    return;
+
+  // samples can't be placed in time before clock sync
+  uint64_t epochMs = clock_epochMs();
+  if (epochMs == 0) {
+    _unsynced++;
+    return;
+  }
+
+  uint32_t start = micros();
+
+  HistorySeries* series = _series;
+  HistorySeries* last = NULL;
+  while (series && (series->_plugin != plugin || series->_sensor != sensor)) {
+    last = series;
+    series = series->_next;
+  }
+
+  if (series == NULL) {
+    if (_seriesCount >= HISTORY_MAX_SERIES)
+      return;
+    series = new HistorySeries(plugin, sensor);
+    if (last)
+      last->_next = series;
+    else
+      _series = series;
+    _seriesCount++;
+  }
+
+  series->append(epochMs / 1000, val);
+
+  _appends++;
+  _appendUs += micros() - start;
+}
+
+HistorySeries* history_find(const char* name) {
+  for (HistorySeries* series = _series; series; series = series->_next) {
+    if (series->getName() == name)
+      return series;
+  }
+  return NULL;
+}
+
+void history_queryDone(uint32_t duration, uint32_t samples) {
+  _queryUs = duration;
+  _querySamples = samples;
+}
+
+void history_getJson(JsonObject* json) {
+  (*json)[F("series")] = _seriesCount;
+  (*json)[F("ram")] = _seriesCount * HISTORY_RAM_SAMPLES * sizeof(HistorySample);
+  (*json)[F("flash")] = HISTORY_FLASH_BYTES;
+
+  JsonArray& list = json->createNestedArray("sensors");
+  for (HistorySeries* series = _series; series; series = series->_next) {
+    list.add(series->getName());
+  }
+
+  // benchmark
+  if (_appends)
+    (*json)[F("appendus")] = (float)_appendUs / _appends;
+  if (_flushes) {
+    (*json)[F("flushus")] = (float)_flushUs / _flushes;
+    (*json)[F("bytespersample")] = (float)_flushBytes / _flushSamples;
+  }
+  (*json)[F("unsynced")] = _unsynced;
+  (*json)[F("queryus")] = _queryUs;
+  (*json)[F("querysamples")] = _querySamples;
+}
@@ -0,0 +1,112 @@
+/**
+ * Sensor history
+ *
+ * Recent samples of each sensor are kept in a RAM ring buffer. Complete
+ * blocks are compressed (delta-of-delta timestamps, zigzag varint value
+ * deltas) and appended to a per-sensor SPIFFS log.
+ *
+ * Timestamps are epoch seconds, samples are only recorded once the clock
+ * is synchronized. Readers work on a snapshot of the ring and the log
+ * size taken when opened, the log isn't rotated while readers are open.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+class Plugin;
+
+#define HISTORY "hist"	// module name
+
+struct HistorySample {
+  uint32_t ts;  // seconds since epoch
+  int32_t val;  // fixed point, value * HISTORY_SCALE
+};
+
+class HistorySeries {
+public:
+  HistorySeries(Plugin* plugin, int16_t sensor);
+  ~HistorySeries();
+
+  void append(uint32_t ts, float val);
+  String getName();
+  String getFile(bool rotated = false);
+
+  Plugin* _plugin;
+  int16_t _sensor;
+  HistorySeries* _next;
+
+  HistorySample* _samples;  // ring buffer
+  uint16_t _head;           // next write position
+  uint16_t _count;          // samples in ring
+  uint16_t _unflushed;      // samples in ring not yet written to flash
+  uint32_t _flushedTs;      // timestamp of last sample written to flash
+  size_t _logSize;          // bytes of complete blocks in current log
+  uint8_t _readers;         // open readers, rotation is deferred
+
+private:
+  bool flush();
+};
+
+/**
+ * Sequential reader over flash log and RAM ring buffer
+ */
+class HistoryReader {
+public:
+  HistoryReader(HistorySeries* series, uint32_t from);
+  ~HistoryReader();
+
+  bool next(HistorySample* sample);
+  size_t readJson(uint8_t* buffer, size_t maxLen);
+
+private:
+  HistorySeries* _series;
+  uint32_t _from;
+  uint8_t _phase;
+  File _file;
+  HistorySample _block[HISTORY_BLOCK_SAMPLES];
+  uint8_t _blockCount;
+  uint8_t _blockPos;
+
+  // snapshot at open
+  size_t _logSize;
+  HistorySample _ram[HISTORY_RAM_SAMPLES];
+  uint16_t _ramCount;
+  uint16_t _ramPos;
+
+  // json streaming
+  uint32_t _samples;
+  uint32_t _duration;
+  char _buf[40];
+  uint8_t _len;
+  uint8_t _pos;
+
+  bool readBlock();
+};
+
+/**
+ * Append sensor value to history
+ */
+void history_append(Plugin* plugin, int16_t sensor, float val);
+
+/**
+ * Find series by name (<plugin>/<addr>)
+ */
+HistorySeries* history_find(const char* name);
+
+/**
+ * Get history store statistics
+ */
+void history_getJson(JsonObject* json);
+
+/**
+ * Record query duration
+ */
+void history_queryDone(uint32_t duration, uint32_t samples);
+
+#endif
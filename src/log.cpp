@@ -0,0 +1,240 @@
+/**
+ * Log buffer
+ */
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#endif
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+#include <WiFiUdp.h>
+
+#include "config.h"
+#include "log.h"
+
+
+#define LOG_LINE_SIZE 150
+#define SYSLOG_PORT 514
+#define SYSLOG_LINES 4 // max lines sent per loop
+#define LOG_MODULES 8  // modules with runtime level
+
+static const char levels[] = "-EWID";
+static const uint8_t severities[] = { 7, 3, 4, 6, 7 };
+
+// ring buffer, positions are monotonic and wrap at buffer size
+static char _buffer[LOG_BUFFER_SIZE];
+static volatile uint32_t _head = 0;
+static uint32_t _uart = 0;
+static uint32_t _syslog = 0;
+
+// statistics
+static uint32_t _messages = 0;
+static uint32_t _dropped = 0;
+
+// runtime levels
+struct LogModule {
+  char name[8];
+  uint8_t level;
+};
+
+static uint8_t _level = LOG_DEBUG;
+static LogModule _modules[LOG_MODULES] = {};
+
+#ifdef LOG_SYSLOG
+static WiFiUDP _udp;
+#endif
+
+// reservation of buffer space is the only critical section
+#ifdef ESP8266
+#define LOG_LOCK() uint32_t savedPS = xt_rsil(15)
+#define LOG_UNLOCK() xt_wsr_ps(savedPS)
+#endif
+#ifdef ESP32
+static portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+#define LOG_LOCK() portENTER_CRITICAL(&_mux)
+#define LOG_UNLOCK() portEXIT_CRITICAL(&_mux)
+#endif
+
+
+uint8_t getLevel(const char *module)
+{
+  for (uint8_t i=0; i<LOG_MODULES && _modules[i].name[0]; i++) {
+    if (strcmp(_modules[i].name, module) == 0)
+      return _modules[i].level;
+  }
+  return _level;
+}
+
+void append(const char *msg, size_t len)
+{
+  if (len > LOG_BUFFER_SIZE)
+    len = LOG_BUFFER_SIZE;
+
+  LOG_LOCK();
+  uint32_t pos = _head;
+  _head += len;
+  for (size_t i=0; i<len; i++)
+    _buffer[(pos + i) % LOG_BUFFER_SIZE] = msg[i];
+  _messages++;
+  LOG_UNLOCK();
+}
+
+/**
+ * Skip reader position to oldest available data, returns skipped bytes
+ */
+uint32_t catchUp(uint32_t& position)
+{
+  uint32_t head = _head;
+  if (head - position <= LOG_BUFFER_SIZE)
+    return 0;
+  uint32_t skipped = head - position - LOG_BUFFER_SIZE;
+  position = head - LOG_BUFFER_SIZE;
+  return skipped;
+}
+
+void log_message(uint8_t level, const char *module, const char *format, ...)
+{
+  if (ESP.getFreeHeap() < g_minFreeHeap) {
+    g_minFreeHeap = ESP.getFreeHeap();
+  }
+
+  if (level > getLevel(module))
+    return;
+
+  char buf[LOG_LINE_SIZE];
+  int len = snprintf(buf, LOG_LINE_SIZE, "%08u %c [%-6s] ", millis(), levels[level], module);
+
+  va_list args;
+  va_start(args, format);
+  len += vsnprintf(buf + len, LOG_LINE_SIZE - len, format, args);
+  va_end(args);
+
+  if (len >= LOG_LINE_SIZE) {
+    len = LOG_LINE_SIZE - 1;
+    buf[len - 1] = '\n';
+  }
+  append(buf, len);
+}
+
+void log_plain(const char *msg)
+{
+  append(msg, strlen(msg));
+}
+
+size_t log_read(uint8_t *buffer, size_t maxLen, uint32_t& position)
+{
+  catchUp(position);
+  size_t len = 0;
+  while (position != _head && len < maxLen) {
+    buffer[len++] = _buffer[position++ % LOG_BUFFER_SIZE];
+  }
+  return len;
+}
+
+uint32_t log_start()
+{
+  uint32_t head = _head;
+  return (head > LOG_BUFFER_SIZE) ? head - LOG_BUFFER_SIZE : 0;
+}
+
+uint32_t log_end()
+{
+  return _head;
+}
+
+#ifdef LOG_SYSLOG
+/**
+ * Send complete lines as RFC 3164 syslog messages
+ */
+void syslog()
+{
+  if (g_syslogHost == "" || WiFi.status() != WL_CONNECTED)
+    return;
+
+  char line[LOG_LINE_SIZE];
+  for (uint8_t lines=0; lines<SYSLOG_LINES; lines++) {
+    catchUp(_syslog);
+
+    // find end of line
+    uint32_t end = _syslog;
+    size_t len = 0;
+    while (end != _head && _buffer[end % LOG_BUFFER_SIZE] != '\n' && len < LOG_LINE_SIZE - 1)
+      line[len++] = _buffer[end++ % LOG_BUFFER_SIZE];
+    if (end == _head)
+      return;
+    line[len] = '\0';
+    _syslog = end + 1;
+
+    // severity from level character after timestamp, facility user
+    const char* level = strchr(line, ' ');
+    level = (level) ? strchr(levels, level[1]) : NULL;
+    uint8_t severity = (level && *level) ? severities[level - levels] : 7;
+
+    _udp.beginPacket(g_syslogHost.c_str(), SYSLOG_PORT);
+    _udp.printf("<%d>%s %s", 8 + severity, net_hostname.c_str(), line);
+    _udp.endPacket();
+  }
+}
+#endif
+
+void log_loop()
+{
+  if (ESP.getFreeHeap() < g_minFreeHeap) {
+    g_minFreeHeap = ESP.getFreeHeap();
+  }
+
+  // write as much as the UART FIFO accepts without blocking
+  _dropped += catchUp(_uart);
+  int space = Serial.availableForWrite();
+  while (_uart != _head && space-- > 0) {
+    Serial.write(_buffer[_uart++ % LOG_BUFFER_SIZE]);
+  }
+
+#ifdef LOG_SYSLOG
+  syslog();
+#endif
+}
+
+void log_flush()
+{
+  _dropped += catchUp(_uart);
+  while (_uart != _head) {
+    Serial.write(_buffer[_uart++ % LOG_BUFFER_SIZE]);
+  }
+  Serial.flush();
+}
+
+bool log_setLevel(const char *module, uint8_t level)
+{
+  if (level > LOG_DEBUG || (module && strlen(module) >= sizeof(_modules[0].name)))
+    return false;
+  if (module == NULL) {
+    _level = level;
+    return true;
+  }
+
+  for (uint8_t i=0; i<LOG_MODULES; i++) {
+    if (_modules[i].name[0] == '\0' || strcmp(_modules[i].name, module) == 0) {
+      strcpy(_modules[i].name, module);
+      _modules[i].level = level;
+      return true;
+    }
+  }
+  return false;
+}
+
+void log_getJson(JsonObject* json)
+{
+  (*json)[F("level")] = _level;
+  (*json)[F("compiledlevel")] = LOG_LEVEL;
+  (*json)[F("size")] = LOG_BUFFER_SIZE;
+  (*json)[F("messages")] = _messages;
+  (*json)[F("dropped")] = _dropped;
+  JsonObject& modules = json->createNestedObject("modules");
+  for (uint8_t i=0; i<LOG_MODULES && _modules[i].name[0]; i++) {
+    modules[_modules[i].name] = _modules[i].level;
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ * Log buffer
+ *
+ * Log messages are formatted into an in-memory ring buffer and drained
+ * to the UART from loop() as far as the UART FIFO allows, so logging
+ * never blocks on the serial port. The buffer is available via /api/log
+ * and optionally forwarded as UDP syslog.
+ *
+ * Messages above LOG_MODULE_LEVEL are removed at compile time. Define
+ * LOG_MODULE_LEVEL before including config.h to change it for a single
+ * translation unit. Runtime levels can be set per module.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// log levels
+#define LOG_NONE 0
+#define LOG_ERROR 1
+#define LOG_WARN 2
+#define LOG_INFO 3
+#define LOG_DEBUG 4
+
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL
+#endif
+
+#define LOG_MSG(level, module, format, ...) do { if ((level) <= LOG_MODULE_LEVEL) log_message(level, module, format, ##__VA_ARGS__); } while (0)
+
+/**
+ * Append formatted message to log buffer
+ */
+void log_message(uint8_t level, const char *module, const char *format, ...);
+
+/**
+ * Append unformatted text to log buffer
+ */
+void log_plain(const char *msg);
+
+/**
+ * Drain log buffer to UART and syslog, call from loop()
+ */
+void log_loop();
+
+/**
+ * Drain log buffer to UART blocking, call before restart or sleep
+ */
+void log_flush();
+
+/**
+ * Set runtime level for module, NULL sets the default level
+ */
+bool log_setLevel(const char *module, uint8_t level);
+
+/**
+ * Read log buffer starting at position, returns bytes read and updates
+ * position. Positions are monotonic, overwritten data is skipped.
+ */
+size_t log_read(uint8_t *buffer, size_t maxLen, uint32_t& position);
+
+/**
+ * Oldest position still available in log buffer
+ */
+uint32_t log_start();
+
+/**
+ * Current write position of log buffer
+ */
+uint32_t log_end();
+
+void log_getJson(JsonObject* json);
+
+#endif
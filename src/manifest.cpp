@@ -0,0 +1,56 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "manifest.h"
+
+
+bool manifest_parseHex(const char* hex, uint8_t* buf, size_t size) {
+  if (strlen(hex) != size * 2)
+    return false;
+  for (size_t i=0; i<size; i++) {
+    if (!isxdigit(hex[0]) || !isxdigit(hex[1]))
+      return false;
+    char byte[3] = { hex[0], hex[1], '\0' };
+    buf[i] = strtoul(byte, NULL, 16);
+    hex += 2;
+  }
+  return true;
+}
+
+bool manifest_valid(Manifest* manifest) {
+  if (!manifest->version || !manifest->image || !manifest->signature || !manifest->sha256)
+    return false;
+  if (manifest->version[0] == '\0' || manifest->image[0] == '\0')
+    return false;
+  return manifest_parseHex(manifest->sha256, manifest->digest, sizeof(manifest->digest));
+}
+
+size_t manifest_signature(const Manifest* manifest, uint8_t* buf, size_t size) {
+  size_t length = strlen(manifest->signature) / 2;
+  if (length == 0 || length > size)
+    return 0;
+  if (!manifest_parseHex(manifest->signature, buf, length))
+    return 0;
+  return length;
+}
+
+int manifest_compareVersions(const char* a, const char* b) {
+  while (*a || *b) {
+    long x = strtol(a, (char**)&a, 10);
+    long y = strtol(b, (char**)&b, 10);
+    if (x != y)
+      return (x < y) ? -1 : 1;
+    if (*a == '.') a++;
+    if (*b == '.') b++;
+    // suffixes like -dev are ignored
+    if ((*a && !isdigit(*a)) || (*b && !isdigit(*b)))
+      break;
+  }
+  return 0;
+}
+
+uint32_t manifest_offset(uint32_t deviceId, uint32_t window) {
+  if (window > MANIFEST_WINDOW_MAX)
+    window = MANIFEST_WINDOW_MAX;
+  return (window) ? deviceId % window : 0;
+}
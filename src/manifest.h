@@ -0,0 +1,56 @@
+/**
+ * Update manifest checks
+ *
+ * Field validation, version comparison and rollout offset of the update
+ * manifest. Pure functions without Arduino dependencies, unit tested on
+ * the host.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_SIZE 32
+#define SIGNATURE_MAX_SIZE 512            // RSA 4096
+#define MANIFEST_WINDOW_MAX (7 * 86400)   // s, keeps install time in ms within int32
+
+
+/**
+ * Manifest fields, strings point into the parsed json and may be NULL
+ */
+struct Manifest {
+  const char* version;
+  const char* image;
+  const char* sha256;
+  const char* signature;
+  uint8_t digest[SHA256_SIZE];
+};
+
+/**
+ * Decode hex string of exactly size bytes
+ */
+bool manifest_parseHex(const char* hex, uint8_t* buf, size_t size);
+
+/**
+ * Check required fields and decode the image digest
+ */
+bool manifest_valid(Manifest* manifest);
+
+/**
+ * Decode signature into buf, returns length or 0 if invalid or larger than size
+ */
+size_t manifest_signature(const Manifest* manifest, uint8_t* buf, size_t size);
+
+/**
+ * Compare dotted version strings, returns <0, 0 or >0 like strcmp
+ */
+int manifest_compareVersions(const char* a, const char* b);
+
+/**
+ * Install delay in s within the rollout window, stable per device
+ */
+uint32_t manifest_offset(uint32_t deviceId, uint32_t window);
+
+#endif
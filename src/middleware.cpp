@@ -0,0 +1,228 @@
+/**
+ * Middleware connection manager
+ */
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#endif
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+#include "middleware.h"
+
+
+#define ERROR_CONNECT -1
+#define ERROR_SEND -2
+#define ERROR_READ -3
+#define ERROR_CLOSED -4 // closed before response, request can be repeated
+
+static WiFiClient _client;
+
+// parsed g_middleware url
+static String _url = "";
+static String _host = "";
+static uint16_t _port = 80;
+static String _base = "";
+
+// statistics
+static uint32_t _requests = 0;
+static uint32_t _connects = 0;
+static uint32_t _reused = 0;
+static uint32_t _serverCloses = 0;
+static uint32_t _errors = 0;
+static uint32_t _handshakeMs = 0;
+static uint32_t _requestMs = 0;
+
+
+/**
+ * Split http://host[:port][/base] into components
+ */
+static bool parseUrl()
+{
+  if (_url == g_middleware && _host != "")
+    return true;
+
+  // url changed - drop old connection
+  _client.stop();
+  _url = g_middleware;
+  _host = "";
+
+  if (!_url.startsWith("http://")) {
+    DEBUG_MSG(MIDDLEWARE, "unsupported url %s\n", _url.c_str());
+    return false;
+  }
+
+  String url = _url.substring(7);
+  int slash = url.indexOf('/');
+  _base = (slash >= 0) ? url.substring(slash) : "";
+  if (_base.endsWith("/"))
+    _base = _base.substring(0, _base.length() - 1);
+  String host = (slash >= 0) ? url.substring(0, slash) : url;
+
+  int colon = host.indexOf(':');
+  _port = (colon >= 0) ? host.substring(colon + 1).toInt() : 80;
+  _host = (colon >= 0) ? host.substring(0, colon) : host;
+  return true;
+}
+
+static bool connect()
+{
+  uint32_t start = millis();
+  if (!_client.connect(_host.c_str(), _port)) {
+    WARN_MSG(MIDDLEWARE, "connect to %s:%d failed\n", _host.c_str(), _port);
+    return false;
+  }
+  _client.setNoDelay(true);
+  _client.setTimeout(MIDDLEWARE_TIMEOUT);
+
+  _connects++;
+  _handshakeMs += millis() - start;
+  return true;
+}
+
+/**
+ * Discard bytes from connection
+ */
+static bool skip(int32_t length)
+{
+  uint8_t buf[64];
+  while (length > 0) {
+    int len = _client.readBytes(buf, min(length, (int32_t)sizeof(buf)));
+    if (len <= 0)
+      return false;
+    length -= len;
+  }
+  return true;
+}
+
+/**
+ * Read response and discard body, returns HTTP status
+ */
+static int readResponse(bool* keepAlive)
+{
+  // a reused connection may have been closed before the request arrived
+  uint32_t start = millis();
+  while (!_client.available()) {
+    if (!_client.connected())
+      return ERROR_CLOSED;
+    if (millis() - start >= MIDDLEWARE_TIMEOUT)
+      return ERROR_READ;
+    delay(1);
+  }
+
+  String line = _client.readStringUntil('\n');
+  if (!line.startsWith("HTTP/1."))
+    return ERROR_READ;
+  int code = line.substring(9, 12).toInt();
+
+  // headers
+  int32_t length = -1;
+  bool chunked = false;
+  *keepAlive = line.startsWith("HTTP/1.1");
+  while (_client.connected() || _client.available()) {
+    line = _client.readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0)
+      break;
+    line.toLowerCase();
+    if (line.startsWith("content-length:"))
+      length = line.substring(15).toInt();
+    else if (line.startsWith("transfer-encoding:") && line.indexOf("chunked") > 0)
+      chunked = true;
+    else if (line.startsWith("connection:"))
+      *keepAlive = line.indexOf("close") < 0;
+  }
+
+  // body
+  if (chunked) {
+    do {
+      line = _client.readStringUntil('\n');
+      length = strtol(line.c_str(), NULL, 16);
+      if (!skip(length + 2)) // data + crlf
+        return ERROR_READ;
+    } while (length > 0);
+  }
+  else if (length >= 0) {
+    if (!skip(length))
+      return ERROR_READ;
+  }
+  else {
+    // no length - body ends with connection
+    *keepAlive = false;
+  }
+
+  return code;
+}
+
+int middleware_post(const String& path)
+{
+  if (!parseUrl())
+    return ERROR_CONNECT;
+
+  uint32_t start = millis();
+  _requests++;
+
+  String request = "POST " + _base + path + F(" HTTP/1.1\r\nHost: ") + _host;
+#ifdef MIDDLEWARE_KEEPALIVE
+  request += F("\r\nConnection: keep-alive");
+#else
+  request += F("\r\nConnection: close");
+#endif
+  request += F("\r\nContent-Length: 0\r\n\r\n");
+
+  int code = ERROR_CONNECT;
+  bool keepAlive = false;
+  bool reused = false;
+
+  // retry once if server closed a reused connection before responding,
+  // a request that may have been processed is never repeated
+  for (uint8_t attempt=0; attempt<2; attempt++) {
+    reused = _client.connected();
+    if (!reused && !connect())
+      break;
+
+    if (_client.write((const uint8_t*)request.c_str(), request.length()) != request.length())
+      code = ERROR_SEND;
+    else
+      code = readResponse(&keepAlive);
+
+    if (!reused || (code != ERROR_SEND && code != ERROR_CLOSED))
+      break;
+
+    DEBUG_MSG(MIDDLEWARE, "connection closed by server\n");
+    _serverCloses++;
+    _client.stop();
+  }
+
+  if (code <= 0 || !keepAlive)
+    _client.stop();
+  if (code <= 0)
+    _errors++;
+  // requests answered on an existing connection
+  else if (reused)
+    _reused++;
+
+  _requestMs += millis() - start;
+  return code;
+}
+
+void middleware_close()
+{
+  _client.stop();
+}
+
+void middleware_getJson(JsonObject* json)
+{
+  (*json)[F("requests")] = _requests;
+  (*json)[F("connects")] = _connects;
+  (*json)[F("servercloses")] = _serverCloses;
+  (*json)[F("errors")] = _errors;
+  if (_requests) {
+    (*json)[F("reuse")] = (float)_reused / _requests;
+    (*json)[F("requestms")] = (float)_requestMs / _requests;
+  }
+  if (_connects)
+    (*json)[F("handshakems")] = (float)_handshakeMs / _connects;
+}
@@ -0,0 +1,35 @@
+/**
+ * Middleware connection manager
+ *
+ * Keeps a single persistent HTTP/1.1 connection to the
+ * middleware open across all plugin uploads. Connections closed by the
+ * server before responding are detected and re-established transparently.
+ */
+
+#ifndef MIDDLEWARE_H
+#define MIDDLEWARE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define MIDDLEWARE "mw"	// module name
+
+/**
+ * POST request to middleware path (e.g. /data/<uuid>.json?value=1)
+ * Returns HTTP status or negative value on connection error
+ */
+int middleware_post(const String& path);
+
+/**
+ * Close connection
+ */
+void middleware_close();
+
+/**
+ * Get connection statistics
+ */
+void middleware_getJson(JsonObject* json);
+
+#endif
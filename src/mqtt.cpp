@@ -0,0 +1,121 @@
+/**
+ * MQTT transport
+ */
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#endif
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+#include <AsyncMqttClient.h>
+
+#include "mqtt.h"
+
+
+AsyncMqttClient mqttClient;
+
+static bool _started = false;
+static uint32_t _reconnectTime = 0;
+static uint32_t _reconnectDelay = MQTT_RECONNECT_DELAY;
+
+// statistics
+static uint32_t _connects = 0;
+static uint32_t _disconnects = 0;
+static uint32_t _published = 0;
+static uint32_t _acknowledged = 0;
+static uint32_t _failed = 0;
+
+
+void onMqttConnect(bool sessionPresent)
+{
+  INFO_MSG(MQTT, "connected (session %s)\n", (sessionPresent) ? "present" : "new");
+  _connects++;
+  _reconnectDelay = MQTT_RECONNECT_DELAY;
+}
+
+void onMqttDisconnect(AsyncMqttClientDisconnectReason reason)
+{
+  WARN_MSG(MQTT, "disconnected (%d), reconnect in %ums\n", (int)reason, _reconnectDelay);
+  _disconnects++;
+
+  // exponential backoff
+  _reconnectTime = millis() + _reconnectDelay;
+  if (_reconnectDelay < MQTT_RECONNECT_MAX_DELAY)
+    _reconnectDelay *= 2;
+}
+
+void onMqttPublish(uint16_t packetId)
+{
+  _acknowledged++;
+}
+
+void mqtt_start()
+{
+  if (g_mqttHost == "")
+    return;
+
+  DEBUG_MSG(MQTT, "broker %s:%d\n", g_mqttHost.c_str(), g_mqttPort);
+
+  mqttClient.onConnect(onMqttConnect);
+  mqttClient.onDisconnect(onMqttDisconnect);
+  mqttClient.onPublish(onMqttPublish);
+
+  // persistent session - broker keeps QoS 1 state across reconnects
+  mqttClient.setServer(g_mqttHost.c_str(), g_mqttPort);
+  mqttClient.setClientId(net_hostname.c_str());
+  mqttClient.setCleanSession(false);
+  mqttClient.setKeepAlive(MQTT_KEEPALIVE);
+  if (g_mqttUser != "")
+    mqttClient.setCredentials(g_mqttUser.c_str(), g_mqttPass.c_str());
+
+  _started = true;
+  _reconnectTime = millis();
+}
+
+void mqtt_loop()
+{
+  if (!_started || mqttClient.connected() || _reconnectTime == 0)
+    return;
+  if ((int32_t)(millis() - _reconnectTime) < 0 || WiFi.status() != WL_CONNECTED)
+    return;
+
+  DEBUG_MSG(MQTT, "connecting\n");
+  _reconnectTime = 0;
+  mqttClient.connect();
+}
+
+bool mqtt_connected()
+{
+  return mqttClient.connected();
+}
+
+bool mqtt_publish(const String& plugin, const char* addr, const char* val)
+{
+  String topic = net_hostname + "/" + plugin + "/" + addr;
+  uint16_t packetId = mqttClient.publish(topic.c_str(), g_mqttQos, g_mqttRetain, val);
+  DEBUG_MSG(MQTT, "publish %s %s (%u)\n", topic.c_str(), val, packetId);
+
+  if (packetId == 0) {
+    _failed++;
+    return false;
+  }
+
+  _published++;
+  // QoS 0 is never acknowledged
+  if (g_mqttQos == 0)
+    _acknowledged++;
+  return true;
+}
+
+void mqtt_getJson(JsonObject* json)
+{
+  (*json)[F("connected")] = mqttClient.connected();
+  (*json)[F("connects")] = _connects;
+  (*json)[F("disconnects")] = _disconnects;
+  (*json)[F("published")] = _published;
+  (*json)[F("acknowledged")] = _acknowledged;
+  (*json)[F("failed")] = _failed;
+}
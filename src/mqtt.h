@@ -0,0 +1,37 @@
+/**
+ * MQTT transport
+ */
+
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define MQTT "mqtt"	// module name
+
+/**
+ * Start MQTT client and connect to broker
+ */
+void mqtt_start();
+
+/**
+ * Reconnect handling, called from main loop()
+ */
+void mqtt_loop();
+
+bool mqtt_connected();
+
+/**
+ * Publish sensor value to <hostname>/<plugin>/<addr>
+ */
+bool mqtt_publish(const String& plugin, const char* addr, const char* val);
+
+/**
+ * Get MQTT client statistics
+ */
+void mqtt_getJson(JsonObject* json);
+
+#endif
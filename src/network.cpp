@@ -0,0 +1,179 @@
+/**
+ * Network connection
+ */
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#endif
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+#include "network.h"
+#include "webserver.h"
+
+#ifdef CAPTIVE_PORTAL
+#include <DNSServer.h>
+const byte DNS_PORT = 53;
+DNSServer dnsServer;
+#endif
+
+
+static uint8_t _state = NETWORK_CONNECTING;
+static uint32_t _startTime = 0;
+static uint32_t _connectMs = 0;   // time to first connection since boot
+
+// reconnect with backoff
+static uint32_t _outageStart = 0;
+static uint32_t _retryTime = 0;
+static uint32_t _backoff = WIFI_BACKOFF_MIN;
+
+// statistics
+static uint32_t _reconnects = 0;
+static uint32_t _outages = 0;
+static uint32_t _outageMs = 0;
+static uint32_t _longestOutageMs = 0;
+
+
+void network_start()
+{
+  // check WiFi connection
+  if (WiFi.getMode() != WIFI_STA) {
+    WiFi.mode(WIFI_STA);
+    delay(10);
+  }
+
+  // configuration changed - set new credentials
+  if (g_ssid != "" && (String(WiFi.SSID()) != g_ssid || String(WiFi.psk()) != g_pass)) {
+    DEBUG_MSG(NETWORK, "connect:    %s\n", g_ssid.c_str());
+    WiFi.begin(g_ssid.c_str(), g_pass.c_str());
+  }
+  else {
+    // reconnect to sdk-configured station
+    DEBUG_MSG(NETWORK, "reconnect:  %s\n", WiFi.SSID().c_str());
+    WiFi.begin();
+  }
+
+  _state = NETWORK_CONNECTING;
+  _startTime = millis();
+}
+
+/**
+ * Fall back to access point mode
+ */
+static void startAP()
+{
+  WARN_MSG(NETWORK, "could not connect to WiFi - going into AP mode\n");
+
+  WiFi.mode(WIFI_AP); // WIFI_AP_STA
+  delay(10);
+
+  WiFi.softAP(ap_default_ssid);
+  DEBUG_MSG(NETWORK, "IP address: %d.%d.%d.%d\n", WiFi.softAPIP()[0], WiFi.softAPIP()[1], WiFi.softAPIP()[2], WiFi.softAPIP()[3]);
+
+#ifdef CAPTIVE_PORTAL
+  // start DNS server for any domain
+  DEBUG_MSG(NETWORK, "starting captive DNS server\n");
+  dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
+#endif
+}
+
+/**
+ * Retry connection with exponential backoff and jitter, restart after
+ * very long outage
+ */
+static void reconnect()
+{
+  uint32_t now = millis();
+  if (WiFi.status() == WL_CONNECTED) {
+    uint32_t outage = now - _outageStart;
+    _outageMs += outage;
+    if (outage > _longestOutageMs)
+      _longestOutageMs = outage;
+    _backoff = WIFI_BACKOFF_MIN;
+    _state = NETWORK_CONNECTED;
+    INFO_MSG(NETWORK, "reconnected after %ums\n", outage);
+    return;
+  }
+
+  if (g_wifiRestartTimeout && (now - _outageStart) / 1000 >= g_wifiRestartTimeout) {
+    if (g_restartTime == 0) {
+      ERROR_MSG(NETWORK, "could not reconnect wifi - restarting\n");
+      g_restartTime = now;
+    }
+    return;
+  }
+
+  if ((int32_t)(now - _retryTime) < 0)
+    return;
+
+  DEBUG_MSG(NETWORK, "reconnecting (%ums backoff)\n", _backoff);
+  WiFi.reconnect();
+  _reconnects++;
+
+  // spread retries of devices sharing an access point
+  _retryTime = now + _backoff + random(_backoff / 2);
+  _backoff = min(_backoff * 2, (uint32_t)WIFI_BACKOFF_MAX);
+}
+
+bool network_loop()
+{
+  switch (_state) {
+    case NETWORK_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED) {
+        _state = NETWORK_CONNECTED;
+        _connectMs = millis();
+        INFO_MSG(NETWORK, "IP address: %d.%d.%d.%d (%ums)\n", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3], millis() - _startTime);
+        return true;
+      }
+      if (millis() - _startTime >= WIFI_CONNECT_TIMEOUT) {
+        _state = NETWORK_AP;
+        startAP();
+        return true;
+      }
+      break;
+
+    case NETWORK_CONNECTED:
+      if (WiFi.status() != WL_CONNECTED) {
+        WARN_MSG(NETWORK, "wifi connection lost\n");
+        _state = NETWORK_RECONNECTING;
+        _outages++;
+        _outageStart = millis();
+        _retryTime = _outageStart + WIFI_BACKOFF_MIN;
+      }
+      break;
+
+    case NETWORK_RECONNECTING:
+      reconnect();
+      break;
+
+    case NETWORK_AP:
+#ifdef CAPTIVE_PORTAL
+      dnsServer.processNextRequest();
+#endif
+      break;
+  }
+
+  return false;
+}
+
+uint8_t network_state()
+{
+  return _state;
+}
+
+void network_getJson(JsonObject* json)
+{
+  static const char* states[] = { "connecting", "connected", "ap", "reconnecting" };
+  (*json)[F("state")] = states[_state];
+  if (_connectMs)
+    (*json)[F("connectms")] = _connectMs;
+  (*json)[F("reconnects")] = _reconnects;
+  (*json)[F("outages")] = _outages;
+  (*json)[F("outagems")] = _outageMs;
+  (*json)[F("longestoutagems")] = _longestOutageMs;
+  if (_state == NETWORK_RECONNECTING)
+    (*json)[F("currentoutagems")] = millis() - _outageStart;
+  (*json)[F("restarttimeout")] = g_wifiRestartTimeout;
+}
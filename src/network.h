@@ -0,0 +1,44 @@
+/**
+ * Network connection
+ *
+ * WiFi association runs in the background while plugins start. If the
+ * station doesn't connect within WIFI_CONNECT_TIMEOUT the access point
+ * (and captive portal) is started from loop().
+ *
+ * Lost connections are re-established with exponential backoff while
+ * sampling continues. The device restarts only if an outage exceeds the
+ * configured restart timeout.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define NETWORK "wifi"	// module name
+
+// network states
+#define NETWORK_CONNECTING 0
+#define NETWORK_CONNECTED 1
+#define NETWORK_AP 2
+#define NETWORK_RECONNECTING 3
+
+/**
+ * Begin station association, doesn't wait for connection
+ */
+void network_start();
+
+/**
+ * Drive connection state, call from loop(). Returns true once when the
+ * network became available as station or access point.
+ */
+bool network_loop();
+
+uint8_t network_state();
+
+void network_getJson(JsonObject* json);
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * Duty-cycle planner
+ */
+
+#include "planner.h"
+#include "plugins/Plugin.h"
+
+
+#define RTC_MAGIC 0x564A5032 // VZP2
+#define RTC_OFFSET 32         // keep clear of OTA command area
+
+struct PlannerRtc {
+  uint32_t magic;
+  uint32_t clock;     // cycle clock at wakeup
+  uint32_t cycles;    // deep sleep cycles
+  uint32_t awakeMs;   // total awake time of all cycles
+  uint32_t phase;     // offset of cycle clock to time of day
+};
+
+#ifdef ESP32
+RTC_DATA_ATTR static PlannerRtc _rtc;
+#else
+static PlannerRtc _rtc;
+#endif
+
+static uint32_t _bursts = 0;
+static uint32_t _burstMs = 0;
+
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t t = b;
+    b = a % b;
+    a = t;
+  }
+  return a;
+}
+
+void planner_start()
+{
+#ifdef ESP8266
+  ESP.rtcUserMemoryRead(RTC_OFFSET, (uint32_t*)&_rtc, sizeof(_rtc));
+#endif
+
+  if (_rtc.magic != RTC_MAGIC || getResetReason(0) != REASON_DEEP_SLEEP_AWAKE) {
+    _rtc.magic = RTC_MAGIC;
+    _rtc.clock = 0;
+    _rtc.cycles = 0;
+    _rtc.awakeMs = 0;
+    _rtc.phase = 0;
+  }
+
+  DEBUG_MSG(PLANNER, "cycle clock %ums\n", _rtc.clock);
+}
+
+uint32_t planner_millis()
+{
+  return _rtc.clock + millis();
+}
+
+uint32_t planner_next(uint32_t period, uint32_t warmup)
+{
+  uint32_t now = planner_millis() + _rtc.phase;
+  return ((now + warmup) / period + 1) * period - warmup - _rtc.phase;
+}
+
+uint32_t planner_align(uint32_t dayMs)
+{
+  const uint32_t day = 24 * 3600 * 1000UL;
+  _rtc.phase = (dayMs + day - planner_millis() % day) % day;
+  return _rtc.phase;
+}
+
+void planner_burst(uint32_t duration)
+{
+  _bursts++;
+  _burstMs += duration;
+}
+
+void planner_sleep(uint32_t duration)
+{
+  _rtc.clock = planner_millis() + duration;
+  _rtc.cycles++;
+  _rtc.awakeMs += millis();
+
+#ifdef ESP8266
+  ESP.rtcUserMemoryWrite(RTC_OFFSET, (uint32_t*)&_rtc, sizeof(_rtc));
+#endif
+}
+
+/**
+ * Cycle is the greatest common divisor of all plugin periods, the device
+ * wakes up at most once per cycle
+ */
+void planner_getJson(JsonObject* json)
+{
+  uint32_t cycle = 0;
+  uint32_t warmup = 0;
+  Plugin::each([&cycle, &warmup](Plugin* plugin) {
+    cycle = gcd(plugin->getPeriod(), cycle);
+    if (plugin->getWarmup() > warmup)
+      warmup = plugin->getWarmup();
+  });
+  if (cycle == 0)
+    return;
+
+  // measured awake time if deep sleeping, otherwise estimated
+  uint32_t awake;
+  if (_rtc.cycles)
+    awake = _rtc.awakeMs / _rtc.cycles;
+  else
+    awake = ENERGY_WIFI_CONNECT_MS + warmup + ((_bursts) ? _burstMs / _bursts : 0);
+  if (awake > cycle)
+    awake = cycle;
+
+  // sleep windows shorter than MIN_SLEEP_DURATION_MS are spent awake
+  uint32_t sleep = cycle - awake;
+  if (sleep < MIN_SLEEP_DURATION_MS)
+    sleep = 0;
+
+  // energy per cycle in mAs
+  float energy = ((cycle - sleep) * ENERGY_AWAKE_MA + sleep * ENERGY_SLEEP_UA / 1000.0) / 1000.0;
+  float current = energy * 1000 / cycle;
+
+  (*json)[F("cycle")] = cycle;
+  (*json)[F("warmup")] = warmup;
+  (*json)[F("awake")] = cycle - sleep;
+  (*json)[F("sleep")] = sleep;
+  (*json)[F("sleepcycles")] = _rtc.cycles;
+  (*json)[F("energy")] = energy;
+  (*json)[F("current")] = current;
+  (*json)[F("batteryhours")] = BATTERY_CAPACITY_MAH / current;
+}
@@ -0,0 +1,55 @@
+/**
+ * Duty-cycle planner
+ *
+ * Provides a cycle clock that continues across deep sleep so plugin
+ * measurement periods stay phase-aligned, and estimates awake time and
+ * energy per cycle.
+ */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define PLANNER "plan"	// module name
+
+/**
+ * Restore cycle clock after deep sleep
+ */
+void planner_start();
+
+/**
+ * Cycle clock in ms, continues across deep sleep
+ */
+uint32_t planner_millis();
+
+/**
+ * Align period boundaries to time of day in ms, returns phase in ms.
+ * Periods dividing a day become aligned to wall-clock boundaries.
+ */
+uint32_t planner_align(uint32_t dayMs);
+
+/**
+ * Next phase-aligned due time for period, warmup ms before the boundary
+ */
+uint32_t planner_next(uint32_t period, uint32_t warmup);
+
+/**
+ * Record upload burst duration for awake time estimate
+ */
+void planner_burst(uint32_t duration);
+
+/**
+ * Save cycle clock and awake statistics before deep sleep
+ */
+void planner_sleep(uint32_t duration);
+
+/**
+ * Get cycle and energy estimates
+ */
+void planner_getJson(JsonObject* json);
+
+#endif
@@ -0,0 +1,87 @@
+#include "Aggregate.h"
+
+
+Aggregate::Aggregate() {
+  reset();
+}
+
+void Aggregate::reset() {
+  _count = 0;
+  _min = NAN;
+  _max = NAN;
+  _mean = NAN;
+  _m2 = 0;
+}
+
+void Aggregate::add(float val) {
+  if (isnan(val) || _count == UINT16_MAX)
+    return;
+
+  if (_count++ == 0) {
+    _min = _max = _mean = val;
+    _m2 = 0;
+    return;
+  }
+
+  if (val < _min)
+    _min = val;
+  if (val > _max)
+    _max = val;
+
+  float delta = val - _mean;
+  _mean += delta / _count;
+  _m2 += delta * (val - _mean);
+}
+
+uint16_t Aggregate::count() {
+  return _count;
+}
+
+float Aggregate::minimum() {
+  return _min;
+}
+
+float Aggregate::maximum() {
+  return _max;
+}
+
+float Aggregate::mean() {
+  return _mean;
+}
+
+float Aggregate::variance() {
+  if (_count < 2)
+    return (_count) ? 0 : NAN;
+  return _m2 / (_count - 1);
+}
+
+void Aggregate::getJson(JsonObject* json) {
+  (*json)[F("count")] = _count;
+  if (_count == 0)
+    return;
+  (*json)[F("min")] = _min;
+  (*json)[F("max")] = _max;
+  (*json)[F("mean")] = _mean;
+  (*json)[F("stddev")] = sqrt(variance());
+}
+
+AggregateWindow::AggregateWindow() : _seq(0) {
+}
+
+void AggregateWindow::publish(const Aggregate& window) {
+  _seq++;
+  __sync_synchronize();
+  _window = window;
+  __sync_synchronize();
+  _seq++;
+}
+
+void AggregateWindow::read(Aggregate* window) {
+  uint32_t seq;
+  do {
+    seq = _seq;
+    __sync_synchronize();
+    *window = _window;
+    __sync_synchronize();
+  } while ((seq & 1) || seq != _seq);
+}
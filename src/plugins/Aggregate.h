@@ -0,0 +1,66 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <Arduino.h>
+#include "../config.h"
+#include <ArduinoJson.h>
+
+
+/**
+ * Constant-memory running statistics of a sensor between two uploads
+ * Mean and variance are updated using Welford's online algorithm
+ */
+class Aggregate {
+public:
+  Aggregate();
+
+  /**
+   * Start new window
+   */
+  void reset();
+
+  /**
+   * Add sample to window. NAN samples are ignored.
+   */
+  void add(float val);
+
+  uint16_t count();
+  float minimum();
+  float maximum();
+  float mean();
+  float variance();
+
+  /**
+   * Get aggregate json
+   */
+  void getJson(JsonObject* json);
+
+private:
+  uint16_t _count;
+  float _min;
+  float _max;
+  float _mean;
+  float _m2;
+};
+
+/**
+ * Last completed window, published by the sampling context and copied
+ * by readers via seqlock
+ */
+class AggregateWindow {
+public:
+  AggregateWindow();
+
+  void publish(const Aggregate& window);
+
+  /**
+   * Get consistent copy of the window, safe from any context
+   */
+  void read(Aggregate* window);
+
+private:
+  volatile uint32_t _seq; // odd while written
+  Aggregate _window;
+};
+
+#endif
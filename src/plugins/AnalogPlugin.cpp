@@ -2,50 +2,110 @@
 
 
 #define SLEEP_PERIOD 10 * 1000
+#define SAMPLE_PERIOD 500
+
+#ifdef ANALOG_SAMPLER
+#define SENSORS 4
+#else
+#define SENSORS 1
+#endif
+
+// sensor addresses, sampler sensors only with ANALOG_SAMPLER
+// rms is the AC rms about the window mean
+static const char* addresses[] = { "a0", "rms", "mean", "peak" };
 
 
 /*
  * Virtual
  */
 
-AnalogPlugin::AnalogPlugin() : Plugin(1, 1) {
+AnalogPlugin::AnalogPlugin() : Plugin(SENSORS, SENSORS) {
   loadConfig();
+  initTiming(SLEEP_PERIOD, SAMPLE_PERIOD);
+  for (int16_t i=0; i<_devs; i++)
+    _devices[i].val = NAN;
+
+#ifdef ANALOG_SAMPLER
+  _sampler.begin(ANALOG_SAMPLE_RATE, ANALOG_WINDOW);
+#endif
 }
 
 String AnalogPlugin::getName() {
   return "analog";
 }
 
-int8_t AnalogPlugin::getSensorByAddr(const char* addr_c) {
-  if (strcmp(addr_c, "a0") == 0)
-    return 0;
+int16_t AnalogPlugin::getSensorByAddr(const char* addr_c) {
+  for (int16_t i=0; i<_devs; i++) {
+    if (strcmp(addr_c, addresses[i]) == 0)
+      return i;
+  }
   return -1;
 }
 
-bool AnalogPlugin::getAddr(char* addr_c, int8_t sensor) {
+bool AnalogPlugin::getAddr(char* addr_c, int16_t sensor) {
+  if (sensor >= _devs)
+    return false;
+  strcpy(addr_c, addresses[sensor]);
+  return true;
+}
+
+float AnalogPlugin::getValue(int16_t sensor) {
   if (sensor >= _devs)
+    return NAN;
+  return _devices[sensor].val;
+}
+
+bool AnalogPlugin::getAggregate(Aggregate* aggregate, int16_t sensor) {
+  if (sensor != 0)
     return false;
-  strcpy(addr_c, "a0");
+  _window.read(aggregate);
   return true;
 }
 
-float AnalogPlugin::getValue(int8_t sensor) {
-  return analogRead(A0) / 1023.0;
+void AnalogPlugin::getPluginJson(JsonObject* json, bool details) {
+  Plugin::getPluginJson(json, details);
+#ifdef ANALOG_SAMPLER
+  if (!details)
+    return;
+  JsonObject& config = (*json)["settings"].as<JsonObject&>();
+  config[F("samplerate")] = _sampler.getRate();
+  config[F("window")] = _sampler.getWindowSamples();
+  config[F("load")] = _sampler.getLoad();
+  config[F("overruns")] = _sampler.getOverruns();
+#endif
+}
+
+bool AnalogPlugin::isTaskSafe() {
+  return true;
 }
 
 /**
- * Loop (idle -> uploading)
+ * Loop (sampling, idle -> uploading)
  */
 void AnalogPlugin::loop() {
   Plugin::loop();
 
-  if (_status == PLUGIN_IDLE && elapsed(SLEEP_PERIOD)) {
-    _status = PLUGIN_UPLOADING;
+#ifdef ANALOG_SAMPLER
+  // A0 is owned by the sampler, use window results
+  if (_sampler.process()) {
+    _devices[1].val = _sampler.acRms();
+    _devices[2].val = _sampler.mean();
+    _devices[3].val = _sampler.peak();
+    for (int16_t i=1; i<_devs; i++)
+      publish(i, _devices[i].val);
+    _aggregate.add(_devices[2].val);
   }
-  if (_status == PLUGIN_UPLOADING) {
-    if (isUploadSafe()) {
-      upload();
-      _status = PLUGIN_IDLE;
-    }
+#else
+  if (sampleElapsed(_timing.sample)) {
+    _aggregate.add(analogRead(A0) / 1023.0);
+  }
+#endif
+
+  if (_status == PLUGIN_IDLE && due()) {
+    // close window, upload window mean
+    _window.publish(_aggregate);
+    _devices[0].val = _aggregate.mean();
+    _aggregate.reset();
+    ready();
   }
 }
@@ -2,16 +2,29 @@
 #define ANALOG_PLUGIN_H
 
 #include "Plugin.h"
+#ifdef ANALOG_SAMPLER
+#include "AnalogSampler.h"
+#endif
 
 
-class AnalogPlugin : public Plugin {
+class AnalogPlugin final : public Plugin {
 public:
   AnalogPlugin();
   String getName() override;
-  int8_t getSensorByAddr(const char* addr_c) override;
-  bool getAddr(char* addr_c, int8_t sensor) override;
-  float getValue(int8_t sensor) override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
+  bool getAggregate(Aggregate* aggregate, int16_t sensor) override;
+  void getPluginJson(JsonObject* json, bool details = true) override;
   void loop() override;
+  bool isTaskSafe() override;
+
+protected:
+  Aggregate _aggregate;    // current window
+  AggregateWindow _window; // last completed window
+#ifdef ANALOG_SAMPLER
+  AnalogSampler _sampler;
+#endif
 };
 
 #endif
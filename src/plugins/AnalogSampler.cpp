@@ -0,0 +1,196 @@
+#include "AnalogSampler.h"
+#include "../config.h"
+
+#ifdef ESP32
+#include <driver/i2s.h>
+#endif
+
+
+#ifdef ESP8266
+#define ADC_MAX 1023
+#define MAX_RATE 1000 // Hz, frequent ADC reads disturb WiFi
+#endif
+#ifdef ESP32
+#define ADC_MAX 4095
+#define MAX_RATE 100000
+#endif
+
+#define MAX_WINDOW_SAMPLES 4096
+#define LOAD_PERIOD 1000
+
+
+/**
+ * Integer square root
+ */
+static uint32_t isqrt64(uint64_t val) {
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > val)
+    bit >>= 2;
+  while (bit) {
+    if (val >= res + bit) {
+      val -= res + bit;
+      res = (res >> 1) + bit;
+    }
+    else
+      res >>= 1;
+    bit >>= 2;
+  }
+  return res;
+}
+
+/*
+ * Public
+ */
+
+AnalogSampler::AnalogSampler() : _rate(0), _windowSamples(0), _count(0), _offset(0), _sum(0), _sumSq(0), _min(UINT16_MAX), _max(0),
+  _mean_q4(0), _rms_q4(0), _peak_q4(0), _kernelCycles(0), _loadTimestamp(0), _load(0), _samples(0), _achieved(0), _overruns(0)
+{
+}
+
+void AnalogSampler::begin(uint32_t rate, uint32_t window) {
+  _rate = min(rate, (uint32_t)MAX_RATE);
+  _windowSamples = min(_rate * window / 1000, (uint32_t)MAX_WINDOW_SAMPLES);
+  if (_windowSamples == 0)
+    _windowSamples = 1;
+  _loadTimestamp = millis();
+
+  DEBUG_MSG("analog", "sampling at %uHz, %u samples per window\n", _rate, _windowSamples);
+
+#ifdef ESP32
+  i2s_config_t config = {};
+  config.mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+  config.sample_rate = _rate;
+  config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+  config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+  config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+  config.dma_buf_count = 4;
+  config.dma_buf_len = SAMPLER_DMA_SAMPLES;
+  i2s_driver_install(I2S_NUM_0, &config, 0, NULL);
+  i2s_set_adc_mode(ADC_UNIT_1, ADC1_CHANNEL_0);
+  i2s_adc_enable(I2S_NUM_0);
+#endif
+}
+
+void AnalogSampler::end() {
+#ifdef ESP32
+  i2s_adc_disable(I2S_NUM_0);
+  i2s_driver_uninstall(I2S_NUM_0);
+#endif
+}
+
+/**
+ * Fixed-point kernel - samples are centered around the previous window's
+ * mean to keep the squares small
+ */
+bool AnalogSampler::accumulate(uint16_t raw) {
+  int32_t val = (int32_t)raw - _offset;
+  _sum += val;
+  _sumSq += val * val;
+  if (raw < _min)
+    _min = raw;
+  if (raw > _max)
+    _max = raw;
+  _samples++;
+
+  if (++_count < _windowSamples)
+    return false;
+  closeWindow();
+  return true;
+}
+
+bool AnalogSampler::process() {
+  uint32_t start = ESP.getCycleCount();
+  uint32_t windows = 0;
+
+#ifdef ESP8266
+  // paced burst, late readings restart the schedule
+  uint32_t period = 1000000 / _rate;
+  uint32_t burst = micros();
+  uint32_t next = burst;
+  while (micros() - burst < SAMPLER_BURST * 1000UL) {
+    while ((int32_t)(micros() - next) < 0)
+      ;
+    windows += accumulate(analogRead(A0));
+    next += period;
+    if ((int32_t)(micros() - next) >= (int32_t)period) {
+      _overruns++;
+      next = micros();
+    }
+  }
+#endif
+#ifdef ESP32
+  // drain dma buffers without blocking, adc1 channel in the upper 4 bits
+  uint16_t buf[SAMPLER_DMA_SAMPLES];
+  size_t bytes;
+  while (i2s_read(I2S_NUM_0, buf, sizeof(buf), &bytes, 0) == ESP_OK && bytes > 0) {
+    for (size_t i=0; i<bytes / sizeof(uint16_t); i++) {
+      windows += accumulate(buf[i] & 0x0FFF);
+    }
+  }
+#endif
+
+  _kernelCycles += ESP.getCycleCount() - start;
+
+  // cpu load and achieved rate per second of sampling
+  uint32_t elapsed = millis() - _loadTimestamp;
+  if (elapsed >= LOAD_PERIOD) {
+    _load = 100.0 * _kernelCycles / ((float)ESP.getCpuFreqMHz() * 1000 * elapsed);
+    _achieved = (uint64_t)_samples * 1000 / elapsed;
+    _kernelCycles = 0;
+    _samples = 0;
+    _loadTimestamp = millis();
+  }
+
+  return windows > 0;
+}
+
+void AnalogSampler::closeWindow() {
+  int64_t n = _count;
+
+  // n * var = sum(x^2) - sum(x)^2 / n
+  uint64_t var_n2 = n * _sumSq - (int64_t)_sum * _sum;
+  _rms_q4 = isqrt64(var_n2 << 8) / n;
+  _mean_q4 = ((int32_t)_offset << 4) + ((int64_t)_sum << 4) / n;
+
+  // peak amplitude about this window's mean
+  uint32_t above = ((uint32_t)_max << 4) - min(_mean_q4, (uint32_t)_max << 4);
+  uint32_t below = _mean_q4 - min(_mean_q4, (uint32_t)_min << 4);
+  _peak_q4 = max(above, below);
+
+  _offset = _mean_q4 >> 4;
+  _count = 0;
+  _sum = 0;
+  _sumSq = 0;
+  _min = UINT16_MAX;
+  _max = 0;
+}
+
+float AnalogSampler::mean() {
+  return _mean_q4 / (16.0 * ADC_MAX);
+}
+
+float AnalogSampler::acRms() {
+  return _rms_q4 / (16.0 * ADC_MAX);
+}
+
+float AnalogSampler::peak() {
+  return _peak_q4 / (16.0 * ADC_MAX);
+}
+
+uint32_t AnalogSampler::getRate() {
+  return _achieved;
+}
+
+uint16_t AnalogSampler::getWindowSamples() {
+  return _windowSamples;
+}
+
+uint32_t AnalogSampler::getOverruns() {
+  return _overruns;
+}
+
+float AnalogSampler::getLoad() {
+  return _load;
+}
@@ -0,0 +1,92 @@
+#ifndef ANALOG_SAMPLER_H
+#define ANALOG_SAMPLER_H
+
+#include <Arduino.h>
+
+
+// i2s dma buffer size in samples
+#define SAMPLER_DMA_SAMPLES 256
+
+// esp8266 sampling burst per process() call in ms
+#define SAMPLER_BURST 20
+
+
+/**
+ * A0 sampler
+ *
+ * The ADC is never read from interrupt context. On ESP32 the I2S
+ * peripheral clocks ADC1 into DMA buffers that process() drains. On
+ * ESP8266 analogRead is neither ISR safe nor can loop() keep up with a
+ * timer, process() takes a paced burst of SAMPLER_BURST ms per call and
+ * readings taken a full period late count as overruns. Samples are
+ * accumulated per window using integer arithmetic only, results are
+ * available after each completed window.
+ */
+class AnalogSampler {
+public:
+  AnalogSampler();
+
+  /**
+   * Start timer with sample rate in Hz and window duration in ms
+   */
+  void begin(uint32_t rate, uint32_t window);
+  void end();
+
+  /**
+   * Take pending samples, returns true if a window has been completed
+   */
+  bool process();
+
+  /**
+   * Results of last completed window, scaled to 0..1 like analogRead
+   */
+  float mean();
+  float peak();
+
+  /**
+   * AC RMS - standard deviation about the window mean, DC removed
+   */
+  float acRms();
+
+  /**
+   * Samples per second actually taken
+   */
+  uint32_t getRate();
+  uint16_t getWindowSamples();
+  uint32_t getOverruns();
+
+  /**
+   * Share of CPU time spent sampling in percent
+   */
+  float getLoad();
+
+private:
+  uint32_t _rate;
+  uint16_t _windowSamples;
+
+  // window accumulators
+  uint16_t _count;
+  uint16_t _offset;   // DC offset, mean of previous window
+  int32_t _sum;
+  uint64_t _sumSq;
+  uint16_t _min;
+  uint16_t _max;
+
+  // window results in ADC counts, Q4 fixed point
+  uint32_t _mean_q4;
+  uint32_t _rms_q4;
+  uint32_t _peak_q4;
+
+  uint32_t _kernelCycles;
+  uint32_t _loadTimestamp;
+  float _load;
+
+  uint32_t _samples;
+  uint32_t _achieved;
+  uint32_t _overruns;
+
+  bool accumulate(uint16_t raw);
+  void closeWindow();
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "DHTFrame.h"
+
+
+// bit period is 50us low plus 26-28us (0) or 70us (1) high
+#define BIT_THRESHOLD 100
+#define BIT_MIN 60
+#define BIT_MAX 160
+
+
+bool dht_decode(const uint32_t* edges, uint8_t count, uint8_t type, float* temperature, float* humidity) {
+  if (count < DHT_FRAME_EDGES - 1)
+    return false;
+
+  uint8_t data[5] = {0};
+  edges += count - (DHT_FRAME_EDGES - 1);
+  for (uint8_t i=0; i<40; i++) {
+    uint32_t period = edges[i+1] - edges[i];
+    if (period < BIT_MIN || period > BIT_MAX)
+      return false;
+    data[i / 8] <<= 1;
+    if (period > BIT_THRESHOLD)
+      data[i / 8] |= 1;
+  }
+
+  if (((data[0] + data[1] + data[2] + data[3]) & 0xFF) != data[4])
+    return false;
+
+  if (type == DHT11) {
+    *humidity = data[0] + data[1] * 0.1;
+    *temperature = data[2] + (data[3] & 0x7F) * 0.1;
+    if (data[3] & 0x80)
+      *temperature = -*temperature;
+  }
+  else {
+    *humidity = ((data[0] << 8) | data[1]) * 0.1;
+    *temperature = (((data[2] & 0x7F) << 8) | data[3]) * 0.1;
+    if (data[2] & 0x80)
+      *temperature = -*temperature;
+  }
+  return true;
+}
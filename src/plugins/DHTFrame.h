@@ -0,0 +1,26 @@
+#ifndef DHT_FRAME_H
+#define DHT_FRAME_H
+
+#include <stdint.h>
+
+
+// sensor types
+#ifndef DHT11
+#define DHT11 11
+#define DHT21 21
+#define DHT22 22
+#endif
+
+// falling edges of a frame: response, 40 data bits, end of frame
+#define DHT_FRAME_EDGES 42
+
+
+/**
+ * Decode DHT frame from falling edge timestamps in us
+ *
+ * Pure function without Arduino dependencies, unit tested on the host.
+ * The last 41 edges are used so a missed response edge is tolerated.
+ */
+bool dht_decode(const uint32_t* edges, uint8_t count, uint8_t type, float* temperature, float* humidity);
+
+#endif
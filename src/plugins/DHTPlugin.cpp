@@ -2,25 +2,32 @@
 #include "DHTPlugin.h"
 
 
+// plugin states
+#define PLUGIN_SETTLING PLUGIN_UPLOADING + 1
+#define PLUGIN_READING PLUGIN_UPLOADING + 2
+#define PLUGIN_RETRYING PLUGIN_UPLOADING + 3
+
 #define SLEEP_PERIOD 10 * 1000
 #define REQUEST_WAIT_DURATION 1 * 1000
+#define MIN_PERIOD 2 * 1000 // DHT22 sampling rate
+#define MAX_RETRIES 2
 
 
 /*
  * Virtual
  */
 
-DHTPlugin::DHTPlugin(uint8_t pin, uint8_t type) : _dht(pin, type), Plugin(2, 2) {
+DHTPlugin::DHTPlugin(uint8_t pin, uint8_t type) : _reader(pin, type), _captureDuration(0), _retries(0), _retried(0), Plugin(2, 2) {
   DEBUG_MSG("dht", "plugin started\n");
   loadConfig();
-  _dht.begin();
+  initTiming(SLEEP_PERIOD, 0);
 }
 
 String DHTPlugin::getName() {
   return "dht";
 }
 
-int8_t DHTPlugin::getSensorByAddr(const char* addr_c) {
+int16_t DHTPlugin::getSensorByAddr(const char* addr_c) {
   if (strcmp(addr_c, "temp") == 0)
     return 0;
   else if (strcmp(addr_c, "humidity") == 0)
@@ -28,7 +35,7 @@ int8_t DHTPlugin::getSensorByAddr(const char* addr_c) {
   return -1;
 }
 
-bool DHTPlugin::getAddr(char* addr_c, int8_t sensor) {
+bool DHTPlugin::getAddr(char* addr_c, int16_t sensor) {
   if (sensor >= _devs)
     return false;
   if (sensor == 0)
@@ -38,39 +45,80 @@ bool DHTPlugin::getAddr(char* addr_c, int8_t sensor) {
   return true;
 }
 
-float DHTPlugin::getValue(int8_t sensor) {
+float DHTPlugin::getValue(int16_t sensor) {
   if (sensor >= _devs)
     return NAN;
   return _devices[sensor].val;
 }
 
+void DHTPlugin::getPluginJson(JsonObject* json, bool details) {
+  Plugin::getPluginJson(json, details);
+  if (!details)
+    return;
+  // failures after the last retry count as sensor errors
+  JsonObject& config = (*json)["settings"].as<JsonObject&>();
+  config[F("retries")] = _retried;
+}
+
+uint32_t DHTPlugin::getWarmup() {
+  return REQUEST_WAIT_DURATION;
+}
+
+uint32_t DHTPlugin::getMinPeriod() {
+  return REQUEST_WAIT_DURATION + MIN_PERIOD;
+}
+
+bool DHTPlugin::isTaskSafe() {
+  return true;
+}
+
 /**
- * Loop (idle -> uploading)
+ * Decode captured frame, retry failed reads after the sensor's minimum period
+ */
+void DHTPlugin::read() {
+  float temperature, humidity;
+  if (_reader.finish(&temperature, &humidity)) {
+    _status = PLUGIN_IDLE;
+    _devices[0].val = temperature;
+    _devices[1].val = humidity;
+    ready();
+    return;
+  }
+
+  if (_retries++ < MAX_RETRIES) {
+    _retried++;
+    _status = PLUGIN_RETRYING;
+    return;
+  }
+
+  _status = PLUGIN_IDLE;
+  _devices[0].val = NAN;
+  _devices[1].val = NAN;
+  for (int16_t i=0; i<2; i++) {
+    readCompleted(i, NAN);
+    publish(i, NAN);
+  }
+
+  // retry failed read only after next period
+  WARN_MSG("dht", "failed reading sensors\n");
+}
+
+/**
+ * Loop (idle -> settling -> reading [-> retrying -> reading] -> uploading)
  */
 void DHTPlugin::loop() {
   Plugin::loop();
 
-  if (_status == PLUGIN_IDLE && elapsed(SLEEP_PERIOD - REQUEST_WAIT_DURATION)) {
-    _status = PLUGIN_UPLOADING;
+  if (_status == PLUGIN_IDLE && due()) {
+    _status = PLUGIN_SETTLING;
+    _retries = 0;
+  }
+  else if ((_status == PLUGIN_SETTLING && elapsed(REQUEST_WAIT_DURATION)) ||
+           (_status == PLUGIN_RETRYING && elapsed(MIN_PERIOD))) {
+    _status = PLUGIN_READING;
+    _captureDuration = _reader.start();
   }
-  if (_status == PLUGIN_UPLOADING) {
-    // force reading- valid for 2 seconds
-    if (_dht.read(true)) {
-      _devices[0].val = _dht.readTemperature();
-      _devices[1].val = _dht.readHumidity();
-
-      if (isUploadSafe()) {
-        upload();
-        _status = PLUGIN_IDLE;
-      }
-    }
-    else {
-      _devices[0].val = NAN;
-      _devices[1].val = NAN;
-
-      // retry failed read only after SLEEP_PERIOD
-      _status = PLUGIN_IDLE;
-      DEBUG_MSG("dht", "failed reading sensors\n");
-    }
+  else if (_status == PLUGIN_READING && elapsed(_captureDuration)) {
+    read();
   }
 }
@@ -1,21 +1,30 @@
 #ifndef DHT_PLUGIN_H
 #define DHT_PLUGIN_H
 
-#include <DHT.h>
 #include "Plugin.h"
+#include "DHTReader.h"
 
 
-class DHTPlugin : public Plugin {
+class DHTPlugin final : public Plugin {
 public:
   DHTPlugin(uint8_t pin, uint8_t type);
   String getName() override;
-  int8_t getSensorByAddr(const char* addr_c) override;
-  bool getAddr(char* addr_c, int8_t sensor) override;
-  float getValue(int8_t sensor) override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
+  void getPluginJson(JsonObject* json, bool details = true) override;
   void loop() override;
+  bool isTaskSafe() override;
+  uint32_t getWarmup() override;
+  uint32_t getMinPeriod() override;
 
 protected:
-  DHT _dht;
+  DHTReader _reader;
+  uint32_t _captureDuration;
+  uint8_t _retries;
+  uint32_t _retried;      // failed reads that were retried
+
+  void read();
 };
 
 #endif
@@ -0,0 +1,77 @@
+#include <Ticker.h>
+#include "DHTReader.h"
+#include "../config.h"
+
+
+#ifdef ESP8266
+#define DHT_ISR_ATTR ICACHE_RAM_ATTR
+#endif
+#ifdef ESP32
+#define DHT_ISR_ATTR IRAM_ATTR
+#endif
+
+#define START_PULSE_DHT11 20  // ms, datasheet min 18
+#define START_PULSE 2         // ms, datasheet min 1
+#define FRAME_DURATION 8      // ms, 40 bits of max 120us plus response
+
+
+/*
+ * Static
+ */
+
+uint8_t DHTReader::_pin = 0;
+volatile uint8_t DHTReader::_count = 0;
+volatile uint32_t DHTReader::_edges[DHT_MAX_EDGES];
+
+static Ticker _ticker;
+
+void DHT_ISR_ATTR DHTReader::_s_edge() {
+  if (_count < DHT_MAX_EDGES)
+    _edges[_count++] = micros();
+}
+
+/**
+ * End start pulse, called from timer context
+ */
+void DHTReader::_s_release() {
+  // line is low, capture starts with the sensor's response
+  attachInterrupt(digitalPinToInterrupt(_pin), _s_edge, FALLING);
+  pinMode(_pin, INPUT_PULLUP);
+}
+
+/*
+ * Public
+ */
+
+DHTReader::DHTReader(uint8_t pin, uint8_t type) : _type(type) {
+  _pin = pin;
+  pinMode(_pin, INPUT_PULLUP);
+}
+
+uint32_t DHTReader::start() {
+  uint32_t pulse = (_type == DHT11) ? START_PULSE_DHT11 : START_PULSE;
+
+  _count = 0;
+  pinMode(_pin, OUTPUT);
+  digitalWrite(_pin, LOW);
+  _ticker.once_ms(pulse, _s_release);
+
+  return pulse + FRAME_DURATION;
+}
+
+bool DHTReader::finish(float* temperature, float* humidity) {
+  _ticker.detach();
+  detachInterrupt(digitalPinToInterrupt(_pin));
+  pinMode(_pin, INPUT_PULLUP);
+
+  uint32_t edges[DHT_MAX_EDGES];
+  uint8_t count = _count;
+  for (uint8_t i=0; i<count; i++)
+    edges[i] = _edges[i];
+
+  if (dht_decode(edges, count, _type, temperature, humidity))
+    return true;
+
+  DEBUG_MSG("dht", "invalid frame (%u edges)\n", count);
+  return false;
+}
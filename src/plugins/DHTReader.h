@@ -0,0 +1,44 @@
+#ifndef DHT_READER_H
+#define DHT_READER_H
+
+#include <Arduino.h>
+#include "DHTFrame.h"
+
+
+#define DHT_MAX_EDGES 48
+
+
+/**
+ * Non-blocking DHT reader
+ *
+ * The host start pulse is ended by a Ticker, afterwards the sensor's
+ * falling edges are timestamped by a GPIO interrupt. Loop and interrupts
+ * keep running during the transfer, the frame is decoded from the edge
+ * timings once complete.
+ */
+class DHTReader {
+public:
+  DHTReader(uint8_t pin, uint8_t type);
+
+  /**
+   * Send start pulse and capture frame, returns capture duration in ms
+   */
+  uint32_t start();
+
+  /**
+   * Stop capture and decode frame
+   */
+  bool finish(float* temperature, float* humidity);
+
+private:
+  uint8_t _type;
+
+  static uint8_t _pin;
+  static volatile uint8_t _count;
+  static volatile uint32_t _edges[DHT_MAX_EDGES];
+
+  static void _s_release();
+  static void _s_edge();
+};
+
+#endif
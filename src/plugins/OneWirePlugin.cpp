@@ -67,7 +67,9 @@ void OneWirePlugin::strToAddr(const char* ptr, uint8_t* addr) {
  */
 
 OneWirePlugin::OneWirePlugin(byte pin) : _devices(), ow(pin), sensors(&ow), Plugin(0, 0) {
+  allocateSettings(MAX_SENSORS);
   loadConfig();
+  initTiming(SLEEP_PERIOD, 0);
 
   // locate _devices on the bus
   DEBUG_MSG("1wire", "looking for 1-Wire devices...\n");
@@ -83,11 +85,11 @@ String OneWirePlugin::getName() {
   return "1wire";
 }
 
-int8_t OneWirePlugin::getSensorByAddr(const char* addr_c) {
+int16_t OneWirePlugin::getSensorByAddr(const char* addr_c) {
   DeviceAddress addr;
   strToAddr(addr_c, addr);
 
-  for (int8_t i=0; i<_devs; i++) {
+  for (int16_t i=0; i<_devs; i++) {
     if (addrCompare(addr, _devices[i].addr)) {
       return i;
     }
@@ -95,53 +97,77 @@ int8_t OneWirePlugin::getSensorByAddr(const char* addr_c) {
   return -1;
 }
 
-bool OneWirePlugin::getAddr(char* addr_c, int8_t sensor) {
+bool OneWirePlugin::getAddr(char* addr_c, int16_t sensor) {
   if (sensor >= _devs)
     return false;
   addrToStr((char*)addr_c, _devices[sensor].addr);
   return true;
 }
 
-bool OneWirePlugin::getUuid(char* uuid_c, int8_t sensor) {
-  if (sensor >= _devs)
-    return false;
-  strcpy(uuid_c, _devices[sensor].uuid);
-  return true;
-}
-
-bool OneWirePlugin::setUuid(const char* uuid_c, int8_t sensor) {
-  if (sensor >= _devs)
-    return false;
-  if (strlen(_devices[sensor].uuid) + strlen(uuid_c) != 36) // erase before update
-    return false;
-  strcpy(_devices[sensor].uuid, uuid_c);
-  return saveConfig();
-}
-
-float OneWirePlugin::getValue(int8_t sensor) {
+float OneWirePlugin::getValue(int16_t sensor) {
   if (sensor >= _devs)
     return NAN;
   return _devices[sensor].val;
 }
 
-void OneWirePlugin::getPluginJson(JsonObject* json) {
-  JsonObject& config = json->createNestedObject("settings");
-  config[F("interval")] = 30;
-  Plugin::getPluginJson(json);
-}
+/**
+ * Config file contains the device table optionally followed by sensor settings
+ */
+// device table of version 1 config files
+struct LegacyDeviceStructOneWire {
+  DeviceAddress addr;
+  char uuid[UUID_LENGTH+1];
+  float val;
+};
 
+/**
+ * Config file contains the uuid table followed by the device addresses.
+ * Version 1 files with formatted uuids are migrated on the next save.
+ */
 bool OneWirePlugin::loadConfig() {
   File configFile = SPIFFS.open(F("/1wire.config"), "r");
-  if (configFile.size() == sizeof(_devices)) {
+  size_t size = configFile.size();
+  size_t legacySize = MAX_SENSORS * sizeof(LegacyDeviceStructOneWire);
+  _configSize = size;
+
+  int16_t count = readTable(configFile);
+  if (count >= 0) {
     DEBUG_MSG("1wire", "reading config file\n");
-    configFile.read((uint8_t*)_devices, sizeof(_devices));
+    _devs = 0;
+    while (_devs < count && configFile.read(_devices[_devs].addr, sizeof(DeviceAddress)) == sizeof(DeviceAddress))
+      _devs++;
+    if (_devs < count) {
+      WARN_MSG("1wire", "config size mismatch\n");
+      // drop uuids of devices whose address is missing
+      clearTable(_devs);
+      markDirty(DIRTY_CONFIG);
+    }
+  }
+  else if (size == legacySize || size == legacySize + MAX_SENSORS * sizeof(SensorSettings)) {
+    DEBUG_MSG("1wire", "migrating config file\n");
+    configFile.seek(0, SeekSet);
+    for (int16_t i=0; i<MAX_SENSORS; i++) {
+      LegacyDeviceStructOneWire device;
+      configFile.read((uint8_t*)&device, sizeof(device));
+      memcpy(_devices[i].addr, device.addr, sizeof(DeviceAddress));
+      device.uuid[UUID_LENGTH] = '\0';
+      storeUuid(i, (strlen(device.uuid) == UUID_LENGTH) ? device.uuid : "");
+    }
+    if (size > legacySize)
+      configFile.read((uint8_t*)_settings, MAX_SENSORS * sizeof(SensorSettings));
 
     // find first empty device slot
     DeviceAddress addr = {};
     char addr_c[20];
     addrToStr(addr_c, addr);
-    _devs = getSensorByAddr(addr_c) + 1;
+    _devs = MAX_SENSORS;
+    int16_t empty = getSensorByAddr(addr_c);
+    if (empty >= 0)
+      _devs = empty;
+    markDirty(DIRTY_CONFIG);
   }
+  else if (size > 0)
+    WARN_MSG("1wire", "config size mismatch\n");
   configFile.close();
   return true;
 }
@@ -150,15 +176,25 @@ bool OneWirePlugin::saveConfig() {
   DEBUG_MSG("1wire", "saving config\n");
   File configFile = SPIFFS.open(F("/1wire.config"), "w");
   if (!configFile) {
-    DEBUG_MSG("1wire", "failed to open config file for writing\n");
+    ERROR_MSG("1wire", "failed to open config file for writing\n");
     return false;
   }
 
-  configFile.write((uint8_t*)_devices, sizeof(_devices));
+  _configSize = writeTable(configFile, _devs);
+  for (int16_t i=0; i<_devs; i++)
+    _configSize += configFile.write(_devices[i].addr, sizeof(DeviceAddress));
   configFile.close();
   return true;
 }
 
+uint32_t OneWirePlugin::getWarmup() {
+  return REQUEST_WAIT_DURATION;
+}
+
+bool OneWirePlugin::isTaskSafe() {
+  return true;
+}
+
 /**
  * Loop (idle -> requesting -> reading)
  */
@@ -169,21 +205,15 @@ void OneWirePlugin::loop() {
   if (!_devs)
     return;
 
-  if (_status == PLUGIN_IDLE && elapsed(SLEEP_PERIOD - REQUEST_WAIT_DURATION)) {
+  if (_status == PLUGIN_IDLE && due()) {
     DEBUG_MSG("1wire", "requesting temp\n");
     _status = PLUGIN_REQUESTING;
     sensors.requestTemperatures();
   }
   else if (_status == PLUGIN_REQUESTING && elapsed(REQUEST_WAIT_DURATION)) {
     DEBUG_MSG("1wire", "reading temp\n");
-    _status = PLUGIN_UPLOADING;
     readTemperatures();
-  }
-  if (_status == PLUGIN_UPLOADING) {
-    if (isUploadSafe()) {
-      upload();
-      _status = PLUGIN_IDLE;
-    }
+    ready();
   }
 }
 
@@ -191,13 +221,13 @@ void OneWirePlugin::setupSensors() {
   DEBUG_MSG("1wire", "found %d devices\n", sensors.getDeviceCount());
 
   DeviceAddress addr;
-  for (int8_t i=0; i<sensors.getDeviceCount(); i++) {
+  for (int16_t i=0; i<sensors.getDeviceCount(); i++) {
     if (sensors.getAddress(addr, i)) {
       char addr_c[20];
       addrToStr((char*)addr_c, addr);
       DEBUG_MSG("1wire", "device: %s ", addr_c);
 
-      int8_t sensorIndex = getSensorIndex(addr);
+      int16_t sensorIndex = getSensorIndex(addr);
       if (sensorIndex >= 0) {
         DEBUG_MSG("1wire", "(known)\n");
       }
@@ -211,7 +241,7 @@ void OneWirePlugin::setupSensors() {
     }
   }
 
-  for (int8_t i=0; i<_devs; i++) {
+  for (int16_t i=0; i<_devs; i++) {
     _devices[i].val = NAN;
   }
 }
@@ -220,8 +250,8 @@ void OneWirePlugin::setupSensors() {
  * Private
  */
 
-int8_t OneWirePlugin::getSensorIndex(const uint8_t* addr) {
-  for (int8_t i=0; i<_devs; ++i) {
+int16_t OneWirePlugin::getSensorIndex(const uint8_t* addr) {
+  for (int16_t i=0; i<_devs; ++i) {
     if (addrCompare(addr, _devices[i].addr)) {
       return i;
     }
@@ -229,9 +259,9 @@ int8_t OneWirePlugin::getSensorIndex(const uint8_t* addr) {
   return(-1);
 }
 
-int8_t OneWirePlugin::addSensor(const uint8_t* addr) {
+int16_t OneWirePlugin::addSensor(const uint8_t* addr) {
   if (_devs >= MAX_SENSORS) {
-    DEBUG_MSG("1wire", "too many devices\n");
+    WARN_MSG("1wire", "too many devices\n");
     return -1;
   }
   for (uint8_t i=0; i<8; i++) {
@@ -241,13 +271,15 @@ int8_t OneWirePlugin::addSensor(const uint8_t* addr) {
 }
 
 void OneWirePlugin::readTemperatures() {
-  for (int8_t i=0; i<_devs; i++) {
+  for (int16_t i=0; i<_devs; i++) {
     _devices[i].val = sensors.getTempC(_devices[i].addr);
     optimistic_yield(OPTIMISTIC_YIELD_TIME);
 
     if (_devices[i].val == DEVICE_DISCONNECTED_C) {
-      DEBUG_MSG("1wire", "device %s disconnected\n", _devices[i].addr);
-      continue;
+      char addr_c[20];
+      addrToStr(addr_c, _devices[i].addr);
+      WARN_MSG("1wire", "device %s disconnected\n", addr_c);
+      _devices[i].val = NAN;
     }
   }
 }
@@ -11,12 +11,11 @@
 
 struct DeviceStructOneWire {
   DeviceAddress addr;
-  char uuid[UUID_LENGTH+1];
   float val;
 };
 
 
-class OneWirePlugin : public Plugin {
+class OneWirePlugin final : public Plugin {
 public:
   static bool addrCompare(const uint8_t* a, const uint8_t* b);
   static void addrToStr(char* ptr, const uint8_t* addr);
@@ -24,23 +23,22 @@ public:
 
   OneWirePlugin(byte pin);
   String getName() override;
-  int8_t getSensorByAddr(const char* addr_c) override;
-  bool getAddr(char* addr_c, int8_t sensor) override;
-  bool getUuid(char* uuid_c, int8_t sensor) override;
-  bool setUuid(const char* uuid_c, int8_t sensor) override;
-  float getValue(int8_t sensor) override;
-  void getPluginJson(JsonObject* json) override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
   bool loadConfig() override;
   bool saveConfig() override;
   void loop() override;
+  bool isTaskSafe() override;
+  uint32_t getWarmup() override;
 
 private:
   OneWire ow;
   DallasTemperature sensors;
   DeviceStructOneWire _devices[MAX_SENSORS];
 
-  int8_t getSensorIndex(const uint8_t* addr);
-  int8_t addSensor(const uint8_t* addr);
+  int16_t getSensorIndex(const uint8_t* addr);
+  int16_t addSensor(const uint8_t* addr);
   void setupSensors();
   void readTemperatures();
 };
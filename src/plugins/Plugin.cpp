@@ -2,54 +2,265 @@
 #include <MD5Builder.h>
 #include <FS.h>
 #include "Plugin.h"
+#include "../history.h"
+#include "../mqtt.h"
+#include "../middleware.h"
+#include "../planner.h"
+#include "../clock.h"
+#include "../tasks.h"
 
 #ifdef ESP32
 #include <SPIFFS.h>
 #endif
 
-#define MAX_PLUGINS 5
+
+// config file version 2: header, uuid validity bitmap, binary uuids and
+// settings of count sensors, optionally followed by plugin data
+#define CONFIG_MAGIC 0x46435A56 // VZCF
+#define CONFIG_VERSION 2
+
+struct ConfigHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+};
+
+// device table of version 1 config files
+struct LegacyDeviceStruct {
+  char uuid[UUID_LENGTH+1];
+  float val;
+};
+
 
 
 /*
  * Static
  */
 
-int8_t Plugin::instances = 0;
-Plugin* Plugin::plugins[MAX_PLUGINS] = {};
-HTTPClient Plugin::http;
+Plugin* Plugin::first = NULL;
+Plugin* Plugin::last = NULL;
+uint32_t Plugin::bursts = 0;
+uint32_t Plugin::uploads = 0;
+uint32_t Plugin::sent = 0;
+uint32_t Plugin::suppressed = 0;
+volatile uint32_t Plugin::generation = 0;
+uint32_t Plugin::firstReading = 0;
+uint32_t Plugin::firstUpload = 0;
+
+// generation and dirty flags are updated from loop(), the web server and
+// the ESP32 tasks
+#ifdef ESP8266
+#define PLUGIN_LOCK() uint32_t savedPS = xt_rsil(15)
+#define PLUGIN_UNLOCK() xt_wsr_ps(savedPS)
+#endif
+#ifdef ESP32
+static portMUX_TYPE _pluginMux = portMUX_INITIALIZER_UNLOCKED;
+#define PLUGIN_LOCK() portENTER_CRITICAL(&_pluginMux)
+#define PLUGIN_UNLOCK() portEXIT_CRITICAL(&_pluginMux)
+#endif
 
-void Plugin::each(CallbackFunction callback) {
-  for (int8_t i=0; i<Plugin::instances; i++) {
-    callback(Plugin::plugins[i]);
+void Plugin::uploadReady(bool sleeping) {
+  // oldest ready reading
+  uint32_t now = millis();
+  uint32_t waiting = 0;
+  bool pending = false;
+  bool measuring = false;
+  for (Plugin* plugin = Plugin::first; plugin; plugin = plugin->_next) {
+    if (plugin->_status == PLUGIN_UPLOADING) {
+      pending = true;
+      if (now - plugin->_readyTimestamp > waiting)
+        waiting = now - plugin->_readyTimestamp;
+    }
+    else if (plugin->_status != PLUGIN_IDLE)
+      measuring = true;
+  }
+  if (!pending)
+    return;
+
+  // flush once a window boundary of the cycle clock passed or max latency
+  // reached. Before deep sleep waiting would only keep the device awake.
+  if (!sleeping || measuring) {
+    uint32_t boundary = planner_next(UPLOAD_WINDOW, 0) - (UPLOAD_WINDOW);
+    if ((int32_t)(planner_millis() - waiting - boundary) >= 0 && waiting < UPLOAD_MAX_LATENCY)
+      return;
+  }
+
+  uint8_t flushed = 0;
+  uint32_t start = millis();
+  for (Plugin* plugin = Plugin::first; plugin; plugin = plugin->_next) {
+    if (plugin->_status == PLUGIN_UPLOADING && plugin->isUploadSafe()) {
+      plugin->upload();
+      plugin->_status = PLUGIN_IDLE;
+      flushed++;
+      yield();
+    }
+  }
+
+  if (flushed) {
+    bursts++;
+    uploads += flushed;
+    planner_burst(millis() - start);
+  }
+}
+
+void Plugin::uploadBurst(Plugin* const* plugins, uint8_t count) {
+  uint8_t flushed = 0;
+  uint32_t start = millis();
+  for (uint8_t i=0; i<count; i++) {
+    Plugin* plugin = plugins[i];
+    // keep reading until upload is possible, the burst freed its queue slot.
+    // If the queue is full anyway the plugin loop retries in the next window
+    if (!plugin->isUploadSafe()) {
+      plugin->_queued = tasks_queueUpload(plugin);
+      continue;
+    }
+    plugin->upload();
+    plugin->_status = PLUGIN_IDLE;
+    flushed++;
+    yield();
+  }
+
+  if (flushed) {
+    bursts++;
+    uploads += flushed;
+    planner_burst(millis() - start);
   }
 }
 
+void Plugin::getUploadJson(JsonObject* json) {
+  (*json)[F("bursts")] = bursts;
+  (*json)[F("uploads")] = uploads;
+  (*json)[F("burstsperhour")] = bursts * 3600000.0 / millis();
+  (*json)[F("sent")] = sent;
+  (*json)[F("suppressed")] = suppressed;
+}
+
+uint32_t Plugin::getGeneration() {
+  return generation;
+}
+
+void Plugin::getBootJson(JsonObject* json) {
+  if (firstReading)
+    (*json)[F("firstreadingms")] = firstReading;
+  if (firstUpload)
+    (*json)[F("firstuploadms")] = firstUpload;
+}
+
 /*
  * Virtual
  */
 
-Plugin::Plugin(int8_t maxDevices = 0, int8_t actualDevices = 0) : _devs(actualDevices),
-  _status(PLUGIN_IDLE), _timestamp(0), _duration(0)
+Plugin::Plugin(int16_t maxDevices = 0, int16_t actualDevices = 0) : _devs(actualDevices), _maxDevs(0),
+  _uuids(NULL), _uuidValid(NULL), _configSize(0), _settings(NULL), _reports(NULL), _values(NULL), _health(NULL), _timing({10 * 1000, 0}), _dirty(0), _readingTime(0), _status(PLUGIN_IDLE), _queued(false), _timestamp(0), _sampleTimestamp(0), _readyTimestamp(0), _acquireTimestamp(0), _due(0)
 {
-  if (Plugin::instances > MAX_PLUGINS) {
-    DEBUG_MSG("plugin", "too many plugins - panic");
-    PANIC();
-  }
-
-  Plugin::plugins[Plugin::instances++] = this;
-  Plugin::http.setReuse(true); // allow reuse (if server supports it)
-
-  // buffer size
-  _size = maxDevices * sizeof(DeviceStruct);
+  // append to registry
+  _next = NULL;
+  if (Plugin::last)
+    Plugin::last->_next = this;
+  else
+    Plugin::first = this;
+  Plugin::last = this;
 
   if (maxDevices > 0) {
-    // DEBUG_MSG("plugin", "alloc %d -> %d\n", maxDevices, _size);
-    _devices = (DeviceStruct*)malloc(_size);
+    _devices = (DeviceStruct*)calloc(maxDevices, sizeof(DeviceStruct));
     if (_devices == NULL)
       PANIC();
+    allocateSettings(maxDevices);
+  }
+}
+
+/**
+ * Allocate per-sensor settings and reporting state
+ */
+void Plugin::allocateSettings(int16_t maxDevices) {
+  _maxDevs = maxDevices;
+  _settings = (SensorSettings*)calloc(maxDevices, sizeof(SensorSettings));
+  _reports = (SensorReport*)calloc(maxDevices, sizeof(SensorReport));
+  _values = (SensorValue*)calloc(maxDevices, sizeof(SensorValue));
+  _health = (SensorHealth*)calloc(maxDevices, sizeof(SensorHealth));
+  _uuids = (uint8_t*)calloc(maxDevices, UUID_SIZE);
+  _uuidValid = (uint8_t*)calloc((maxDevices + 7) / 8, 1);
+  if (_settings == NULL || _reports == NULL || _values == NULL || _health == NULL || _uuids == NULL || _uuidValid == NULL)
+    PANIC();
+}
+
+/**
+ * Update sensor health with result of a reading
+ */
+void Plugin::readCompleted(int16_t sensor, float val) {
+  SensorHealth* health = &_health[sensor];
+  health->reads++;
+  if (_acquireTimestamp)
+    health->latency = min(millis() - _acquireTimestamp, (uint32_t)UINT16_MAX);
+
+  if (isnan(val)) {
+    health->errors++;
+    if (health->consecutive < UINT16_MAX)
+      health->consecutive++;
+  }
+  else {
+    health->lastSuccess = millis();
+    health->consecutive = 0;
+  }
+}
+
+/**
+ * Update sensor health with upload result, status is a HTTP status or
+ * negative on error
+ */
+void Plugin::uploadCompleted(int16_t sensor, int status) {
+  SensorHealth* health = &_health[sensor];
+  if (status >= 200 && status < 300)
+    health->uploads++;
+  else {
+    health->uploadErrors++;
+    health->lastUploadError = status;
   }
 }
 
+/**
+ * Publish sensor value for readers outside loop() - single writer seqlock
+ */
+void Plugin::publish(int16_t sensor, float val) {
+  PLUGIN_LOCK();
+  uint32_t current = ++generation;
+  if (firstReading == 0 && !isnan(val))
+    firstReading = millis();
+  PLUGIN_UNLOCK();
+
+  SensorValue* value = &_values[sensor];
+  value->seq++;
+  __sync_synchronize();
+  value->val = val;
+  value->timestamp = millis();
+  value->time = _readingTime;
+  value->generation = current;
+  value->valid = !isnan(val);
+  __sync_synchronize();
+  value->seq++;
+}
+
+bool Plugin::getSnapshot(SensorValue* value, int16_t sensor) {
+  if (sensor >= _devs)
+    return false;
+
+  SensorValue* current = &_values[sensor];
+  uint32_t seq;
+  do {
+    seq = current->seq;
+    __sync_synchronize();
+    value->val = current->val;
+    value->timestamp = current->timestamp;
+    value->time = current->time;
+    value->generation = current->generation;
+    value->valid = current->valid;
+    __sync_synchronize();
+  } while ((seq & 1) || seq != current->seq);
+
+  value->seq = seq;
+  return true;
+}
+
 Plugin::~Plugin() {
 }
 
@@ -57,35 +268,120 @@ String Plugin::getName() {
   return "abstract";
 }
 
-int8_t Plugin::getSensors() {
+int16_t Plugin::getSensors() {
   return _devs;
 }
 
-int8_t Plugin::getSensorByAddr(const char* addr_c) {
+int16_t Plugin::getSensorByAddr(const char* addr_c) {
   return -1;
 }
 
-bool Plugin::getAddr(char* addr_c, int8_t sensor) {
+bool Plugin::getAddr(char* addr_c, int16_t sensor) {
   return false;
 }
 
-bool Plugin::getUuid(char* uuid_c, int8_t sensor) {
+bool Plugin::getUuid(char* uuid_c, int16_t sensor) {
+  if (sensor >= _devs)
+    return false;
+  if (hasUuid(sensor))
+    formatUuid(uuid_c, &_uuids[sensor * UUID_SIZE]);
+  else
+    uuid_c[0] = '\0';
+  return true;
+}
+
+bool Plugin::setUuid(const char* uuid_c, int16_t sensor) {
   if (sensor >= _devs)
     return false;
-  strcpy(uuid_c, _devices[sensor].uuid);
+  // erase before update
+  if (strlen(uuid_c) != ((hasUuid(sensor)) ? 0 : UUID_LENGTH))
+    return false;
+  if (!storeUuid(sensor, uuid_c))
+    return false;
+  markDirty(DIRTY_CONFIG);
+  return true;
+}
+
+bool Plugin::parseUuid(const char* uuid_c, uint8_t* uuid) {
+  for (uint8_t i=0; i<UUID_SIZE; i++) {
+    // hyphens after 4, 6, 8 and 10 bytes
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      if (*uuid_c++ != '-')
+        return false;
+    }
+    if (!isxdigit(uuid_c[0]) || !isxdigit(uuid_c[1]))
+      return false;
+    char hex[3] = { uuid_c[0], uuid_c[1], '\0' };
+    uuid[i] = strtoul(hex, NULL, 16);
+    uuid_c += 2;
+  }
+  return *uuid_c == '\0';
+}
+
+void Plugin::formatUuid(char* uuid_c, const uint8_t* uuid) {
+  for (uint8_t i=0; i<UUID_SIZE; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      *uuid_c++ = '-';
+    sprintf(uuid_c, "%02x", uuid[i]);
+    uuid_c += 2;
+  }
+}
+
+bool Plugin::hasUuid(int16_t sensor) {
+  return _uuidValid[sensor / 8] & (1 << (sensor % 8));
+}
+
+/**
+ * Store formatted uuid in packed table, empty uuid erases
+ */
+bool Plugin::storeUuid(int16_t sensor, const char* uuid_c) {
+  if (uuid_c[0] == '\0') {
+    _uuidValid[sensor / 8] &= ~(1 << (sensor % 8));
+    return true;
+  }
+  if (!parseUuid(uuid_c, &_uuids[sensor * UUID_SIZE]))
+    return false;
+  _uuidValid[sensor / 8] |= 1 << (sensor % 8);
   return true;
 }
 
-bool Plugin::setUuid(const char* uuid_c, int8_t sensor) {
+bool Plugin::getSettings(SensorSettings* settings, int16_t sensor) {
   if (sensor >= _devs)
     return false;
-  if (strlen(_devices[sensor].uuid) + strlen(uuid_c) != UUID_LENGTH) // erase before update
+  *settings = _settings[sensor];
+  return true;
+}
+
+bool Plugin::setSettings(const SensorSettings* settings, int16_t sensor) {
+  if (sensor >= _devs || settings->deadband < 0 || settings->relative < 0)
     return false;
-  strcpy(_devices[sensor].uuid, uuid_c);
-  return saveConfig();
+  _settings[sensor] = *settings;
+  markDirty(DIRTY_CONFIG);
+  return true;
+}
+
+/**
+ * Defer config writes, flushed from loop() by flushConfig()
+ */
+void Plugin::markDirty(uint8_t what) {
+  PLUGIN_LOCK();
+  _dirty |= what;
+  PLUGIN_UNLOCK();
+  configChanged();
+}
+
+void Plugin::persist() {
+  PLUGIN_LOCK();
+  uint8_t dirty = _dirty;
+  _dirty = 0;
+  PLUGIN_UNLOCK();
+  if (dirty & DIRTY_CONFIG)
+    saveConfig();
+  if (dirty & DIRTY_TIMING)
+    saveTiming();
 }
 
-String Plugin::getHash(int8_t sensor) {
+String Plugin::getHash(int16_t sensor) {
   char addr_c[32];
   if (getAddr(&addr_c[0], sensor)) {
     MD5Builder md5 = ::getHashBuilder();
@@ -97,124 +393,431 @@ String Plugin::getHash(int8_t sensor) {
   return "";
 }
 
-float Plugin::getValue(int8_t sensor) {
+float Plugin::getValue(int16_t sensor) {
   return NAN;
 }
 
-void Plugin::getPluginJson(JsonObject* json) {
+bool Plugin::getAggregate(Aggregate* aggregate, int16_t sensor) {
+  return false;
+}
+
+void Plugin::getPluginJson(JsonObject* json, bool details) {
+  if (details) {
+    JsonObject& config = json->createNestedObject("settings");
+    config[F("interval")] = getPeriod() / 1000.0;
+    config[F("mininterval")] = getMinPeriod() / 1000.0;
+    if (getSamplePeriod() > 0)
+      config[F("sampling")] = getSamplePeriod();
+
+    // uuid table size, savings per sensor against formatted uuids
+    JsonObject& table = json->createNestedObject("table");
+    table[F("capacity")] = _maxDevs;
+    table[F("configbytes")] = _configSize;
+    table[F("ramsaved")] = sizeof(LegacyDeviceStruct) - sizeof(float) - UUID_SIZE;
+    table[F("configsaved")] = sizeof(LegacyDeviceStruct) - UUID_SIZE;
+  }
+
   JsonArray& sensorlist = json->createNestedArray("sensors");
-  for (int8_t i=0; i<getSensors(); i++) {
+  for (int16_t i=0; i<getSensors(); i++) {
     JsonObject& data = sensorlist.createNestedObject();
-    getSensorJson(&data, i);
+    getSensorJson(&data, i, details);
   }
 }
 
-void Plugin::getSensorJson(JsonObject* json, int8_t sensor) {
+void Plugin::getSensorJson(JsonObject* json, int16_t sensor, bool details) {
   char buf[UUID_LENGTH+1];
   if (getAddr(buf, sensor))
     (*json)[F("addr")] = String(buf);
-  if (getUuid(buf, sensor))
+  if (details && getUuid(buf, sensor))
     (*json)[F("uuid")] = String(buf);
 
-  float val = getValue(sensor);
-  if (isnan(val))
+  SensorValue value;
+  if (!getSnapshot(&value, sensor) || !value.valid)
     (*json)[F("value")] = JSON_NULL;
-  else
-    (*json)[F("value")] = val;
+  else {
+    (*json)[F("value")] = value.val;
+    (*json)[F("age")] = millis() - value.timestamp;
+    if (value.time)
+      (*json)[F("timestamp")] = value.time;
+  }
+
+  if (!details)
+    return;
+
+  if (sensor < _devs) {
+    JsonObject& reporting = json->createNestedObject("reporting");
+    reporting[F("deadband")] = _settings[sensor].deadband;
+    reporting[F("relative")] = _settings[sensor].relative;
+    reporting[F("heartbeat")] = _settings[sensor].heartbeat;
+    reporting[F("sent")] = _reports[sensor].sent;
+    reporting[F("suppressed")] = _reports[sensor].suppressed;
+
+    SensorHealth* health = &_health[sensor];
+    JsonObject& healthJson = json->createNestedObject("health");
+    if (health->lastSuccess)
+      healthJson[F("successage")] = millis() - health->lastSuccess;
+    healthJson[F("reads")] = health->reads;
+    healthJson[F("errors")] = health->errors;
+    healthJson[F("consecutive")] = health->consecutive;
+    healthJson[F("latencyms")] = health->latency;
+    healthJson[F("uploads")] = health->uploads;
+    healthJson[F("uploaderrors")] = health->uploadErrors;
+    if (health->uploadErrors)
+      healthJson[F("lastuploaderror")] = health->lastUploadError;
+  }
+
+  Aggregate aggregate;
+  if (getAggregate(&aggregate, sensor)) {
+    JsonObject& stats = json->createNestedObject("stats");
+    aggregate.getJson(&stats);
+  }
 
   (*json)[F("hash")] = getHash(sensor);
 }
 
+/**
+ * Read version 2 uuid table and settings, returns number of sensors or
+ * -1 if file has a different format or is truncated
+ */
+int16_t Plugin::readTable(File& file) {
+  ConfigHeader header;
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      header.magic != CONFIG_MAGIC || header.version != CONFIG_VERSION || header.count > _maxDevs)
+    return -1;
+
+  size_t bitmap = (header.count + 7) / 8;
+  size_t uuids = header.count * UUID_SIZE;
+  size_t settings = header.count * sizeof(SensorSettings);
+  if (file.read(_uuidValid, bitmap) != bitmap ||
+      file.read(_uuids, uuids) != uuids ||
+      file.read((uint8_t*)_settings, settings) != settings) {
+    clearTable(0);
+    return -1;
+  }
+  return header.count;
+}
+
+/**
+ * Erase uuids and settings of sensors from given index on
+ */
+void Plugin::clearTable(int16_t from) {
+  for (int16_t sensor=from; sensor<_maxDevs; sensor++) {
+    _uuidValid[sensor / 8] &= ~(1 << (sensor % 8));
+    memset(&_uuids[sensor * UUID_SIZE], 0, UUID_SIZE);
+    memset(&_settings[sensor], 0, sizeof(SensorSettings));
+  }
+}
+
+size_t Plugin::writeTable(File& file, int16_t count) {
+  ConfigHeader header = { CONFIG_MAGIC, CONFIG_VERSION, (uint16_t)count };
+  size_t size = file.write((uint8_t*)&header, sizeof(header));
+  size += file.write(_uuidValid, (count + 7) / 8);
+  size += file.write(_uuids, count * UUID_SIZE);
+  size += file.write((uint8_t*)_settings, count * sizeof(SensorSettings));
+  return size;
+}
+
+/**
+ * Version 1 config files contain the device table with formatted uuids,
+ * optionally followed by sensor settings. They are migrated to version 2
+ * on the next save.
+ */
 bool Plugin::loadConfig() {
   File configFile = SPIFFS.open("/" + getName() + ".config", "r");
-  if (configFile.size() == _size) {
-    DEBUG_MSG(getName().c_str(), "loading config\n", _size);
-    configFile.read((uint8_t*)_devices, _size);
+  size_t size = configFile.size();
+  size_t entrySize = sizeof(LegacyDeviceStruct) + sizeof(SensorSettings);
+  _configSize = size;
+
+  if (size == 0)
+    DEBUG_MSG(getName().c_str(), "config not found\n");
+  else if (readTable(configFile) >= 0)
+    DEBUG_MSG(getName().c_str(), "loading config\n");
+  else if ((size % entrySize == 0 && size / entrySize <= _maxDevs) ||
+           (size % sizeof(LegacyDeviceStruct) == 0 && size / sizeof(LegacyDeviceStruct) <= _maxDevs)) {
+    DEBUG_MSG(getName().c_str(), "migrating config\n");
+    bool settings = size % entrySize == 0;
+    int16_t devs = size / ((settings) ? entrySize : sizeof(LegacyDeviceStruct));
+    configFile.seek(0, SeekSet);
+    for (int16_t sensor=0; sensor<devs; sensor++) {
+      LegacyDeviceStruct device;
+      configFile.read((uint8_t*)&device, sizeof(device));
+      device.uuid[UUID_LENGTH] = '\0';
+      storeUuid(sensor, (strlen(device.uuid) == UUID_LENGTH) ? device.uuid : "");
+    }
+    if (settings)
+      configFile.read((uint8_t*)_settings, devs * sizeof(SensorSettings));
+    markDirty(DIRTY_CONFIG);
   }
-  else if (configFile.size() == 0)
-    DEBUG_MSG(getName().c_str(), "config not found\n", _size);
   else
-    DEBUG_MSG(getName().c_str(), "config size mismatch\n", _size);
-
-  for (int8_t sensor = 0; sensor<getSensors(); sensor++)
-    if (strlen(_devices[sensor].uuid) != UUID_LENGTH)
-      _devices[sensor].uuid[0] = '\0';
+    WARN_MSG(getName().c_str(), "config size mismatch\n");
 
   configFile.close();
   return true;
 }
 
 bool Plugin::saveConfig() {
-  DEBUG_MSG(getName().c_str(), "saving config %d\n", _size);
   File configFile = SPIFFS.open("/" + getName() + ".config", "w");
   if (!configFile) {
-    DEBUG_MSG(getName().c_str(), "failed to open config file for writing\n");
+    ERROR_MSG(getName().c_str(), "failed to open config file for writing\n");
     return false;
   }
-  configFile.write((uint8_t*)_devices, _size);
+  _configSize = writeTable(configFile, _devs);
   configFile.close();
+  DEBUG_MSG(getName().c_str(), "saved config %u\n", _configSize);
   return true;
 }
 
 void Plugin::loop() {
   // DEBUG_MSG(getName().c_str(), "loop %d\n", _status);
+  // retry handing over a reading that found the upload queue full
+  if (_status == PLUGIN_UPLOADING && !_queued && tasks_running())
+    _queued = tasks_queueUpload(this);
 }
 
-void Plugin::upload() {
-  if (g_middleware == "")
-    return;
+/**
+ * Readings available - record and queue for upload
+ */
+void Plugin::ready() {
+  record();
+  _readyTimestamp = millis();
+  _readingTime = clock_epochMs();
+  for (int16_t i=0; i<getSensors(); i++) {
+    float val = getValue(i);
+    readCompleted(i, val);
+    publish(i, val);
+  }
+
+  _queued = false;
+  _status = PLUGIN_UPLOADING;
+
+  // hand over to upload task, retried from loop() if queue is full
+  if (tasks_running())
+    _queued = tasks_queueUpload(this);
+}
+
+/**
+ * Record current sensor values in history
+ */
+void Plugin::record() {
+  for (int16_t i=0; i<getSensors(); i++) {
+    history_append(this, i, getValue(i));
+  }
+}
 
+void Plugin::upload() {
   char uuid_c[UUID_LENGTH+1];
   char val_c[16];
 
-  for (int8_t i=0; i<getSensors(); i++) {
+  // mqtt publishes all sensors, no uuid required
+  if (g_transport == TRANSPORT_MQTT) {
+    for (int16_t i=0; i<getSensors(); i++) {
+      float val = getValue(i);
+      if (isnan(val) || !getAddr(uuid_c, i) || !isReportDue(i, val))
+        continue;
+      dtostrf(val, -4, 2, val_c);
+      bool published = mqtt_publish(getName(), uuid_c, val_c);
+      uploadCompleted(i, (published) ? 200 : -1);
+      if (published)
+        reported(i, val);
+      else
+        WARN_MSG(getName().c_str(), "publish %s failed\n", uuid_c);
+    }
+    return;
+  }
+
+  if (g_middleware == "")
+    return;
+
+  for (int16_t i=0; i<getSensors(); i++) {
     // uuid configured?
     getUuid(uuid_c, i);
     if (strlen(uuid_c) > 0) {
       float val = getValue(i);
 
-      if (isnan(val))
-        break;
+      if (isnan(val) || !isReportDue(i, val))
+        continue;
 
       dtostrf(val, -4, 2, val_c);
 
-      String uri = g_middleware + F("/data/") + String(uuid_c) + F(".json?value=") + String(val_c);
-      http.begin(uri);
-      int httpCode = http.POST("");
-      if (httpCode > 0) {
-        http.getString();
+      String uri = String(F("/data/")) + uuid_c + F(".json?value=") + val_c;
+
+      // acquisition time in ms
+      if (_readingTime) {
+        char ts_c[16];
+        sprintf(ts_c, "%u%03u", (uint32_t)(_readingTime / 1000), (uint32_t)(_readingTime % 1000));
+        uri += String(F("&ts=")) + ts_c;
+      }
+      int httpCode = middleware_post(uri);
+      uploadCompleted(i, httpCode);
+      if (httpCode >= 200 && httpCode < 300) {
+        DEBUG_MSG(getName().c_str(), "POST %d %s\n", httpCode, uri.c_str());
+        reported(i, val);
       }
-      DEBUG_MSG(getName().c_str(), "POST %d %s\n", httpCode, uri.c_str());
-      http.end();
+      else
+        WARN_MSG(getName().c_str(), "POST %d %s\n", httpCode, uri.c_str());
     }
   }
 }
 
+/**
+ * Deadband check - value is reported if it left the deadband around the
+ * last reported value or the heartbeat interval expired
+ */
+bool Plugin::isReportDue(int16_t sensor, float val) {
+  SensorSettings* settings = &_settings[sensor];
+  SensorReport* report = &_reports[sensor];
+
+  if (report->timestamp == 0 || (settings->deadband == 0 && settings->relative == 0))
+    return true;
+  if (settings->heartbeat > 0 && millis() - report->timestamp >= settings->heartbeat * 1000)
+    return true;
+
+  float delta = fabs(val - report->val);
+  if (delta > settings->deadband && delta > fabs(report->val) * settings->relative / 100)
+    return true;
+
+  report->suppressed++;
+  suppressed++;
+  return false;
+}
+
+void Plugin::reported(int16_t sensor, float val) {
+  _reports[sensor].val = val;
+  _reports[sensor].timestamp = millis();
+  _reports[sensor].sent++;
+  sent++;
+  if (firstUpload == 0)
+    firstUpload = millis();
+}
+
 bool Plugin::isUploadSafe() {
   // no upload in AP mode, no logging
   if ((WiFi.getMode() & WIFI_STA) == 0)
     return false;
   bool isSafe = WiFi.status() == WL_CONNECTED && ESP.getFreeHeap() >= HTTP_MIN_HEAP;
+  if (g_transport == TRANSPORT_MQTT)
+    isSafe = isSafe && mqtt_connected();
   if (!isSafe) {
-    DEBUG_MSG(getName().c_str(), "cannot upload (wifi: %d mem:%d)\n", WiFi.status(), ESP.getFreeHeap());
+    WARN_MSG(getName().c_str(), "cannot upload (wifi: %d mem:%d)\n", WiFi.status(), ESP.getFreeHeap());
   }
   return isSafe;
 }
 
+/**
+ * Measurement due - fires warmup ms before each aligned period boundary
+ */
+bool Plugin::due() {
+  if ((int32_t)(planner_millis() - _due) < 0)
+    return false;
+  _due = planner_next(getPeriod(), getWarmup());
+  _timestamp = millis();
+  _acquireTimestamp = _timestamp;
+  return true;
+}
+
 bool Plugin::elapsed(uint32_t duration) {
   if (_timestamp == 0 || millis() - _timestamp >= duration) {
     _timestamp = millis();
     return true;
   }
-  _duration = duration;
+  return false;
+}
+
+/**
+ * Sample timer - independent of the upload timer and not considered for sleep
+ */
+bool Plugin::sampleElapsed(uint32_t duration) {
+  if (_sampleTimestamp == 0 || millis() - _sampleTimestamp >= duration) {
+    _sampleTimestamp = millis();
+    return true;
+  }
   return false;
 }
 
 uint32_t Plugin::getMaxSleepDuration() {
-  if (_timestamp == 0)
+  // nothing to measure
+  if (_devs == 0)
     return -1;
-  uint32_t elapsed = millis() - _timestamp;
-  if (elapsed < _duration)
-    return _duration - elapsed;
+  // measuring or queued readings not uploaded yet
+  if (_status != PLUGIN_IDLE)
+    return 0;
+  int32_t remaining = _due - planner_millis();
+  return (remaining > 0) ? remaining : 0;
+}
+
+uint32_t Plugin::getPeriod() {
+  return _timing.period;
+}
+
+uint32_t Plugin::getWarmup() {
   return 0;
 }
+
+bool Plugin::isTaskSafe() {
+  return false;
+}
+
+uint32_t Plugin::getSamplePeriod() {
+  return _timing.sample;
+}
+
+uint32_t Plugin::getMinPeriod() {
+  return getWarmup() + 1000;
+}
+
+/**
+ * Set plugin default intervals, load persisted intervals and schedule the
+ * first measurement
+ */
+void Plugin::initTiming(uint32_t period, uint32_t sample) {
+  _timing.period = period;
+  _timing.sample = sample;
+
+  File file = SPIFFS.open("/" + getName() + ".timing", "r");
+  if (file.size() == sizeof(PluginTiming)) {
+    PluginTiming timing;
+    file.read((uint8_t*)&timing, sizeof(timing));
+    // sampling is a plugin property and not configurable
+    if (timing.period >= getMinPeriod() && (sample == 0) == (timing.sample == 0))
+      _timing = timing;
+  }
+  file.close();
+
+  // cold boot measures immediately. After deep sleep the aligned grid is
+  // continued, a reading planned up to SLEEP_SAFETY_MARGIN ago is taken.
+  if (getResetReason(0) != REASON_DEEP_SLEEP_AWAKE)
+    _due = planner_millis();
+  else {
+    _due = planner_next(getPeriod(), getWarmup());
+    if (planner_millis() - (_due - getPeriod()) <= SLEEP_SAFETY_MARGIN)
+      _due -= getPeriod();
+  }
+}
+
+bool Plugin::setTiming(uint32_t period, uint32_t sample) {
+  if (period < getMinPeriod())
+    return false;
+  if ((_timing.sample == 0) != (sample == 0) || (sample > 0 && (sample < LOOP_DELAY || sample > period)))
+    return false;
+
+  _timing.period = period;
+  _timing.sample = sample;
+  DEBUG_MSG(getName().c_str(), "period %u sample %u\n", period, sample);
+
+  // realign pending measurement to new period
+  _due = planner_next(getPeriod(), getWarmup());
+
+  markDirty(DIRTY_TIMING);
+  return true;
+}
+
+bool Plugin::saveTiming() {
+  File file = SPIFFS.open("/" + getName() + ".timing", "w");
+  if (!file) {
+    ERROR_MSG(getName().c_str(), "failed to open timing file for writing\n");
+    return false;
+  }
+  file.write((uint8_t*)&_timing, sizeof(_timing));
+  file.close();
+  return true;
+}
@@ -4,37 +4,116 @@
 #include <Arduino.h>
 #ifdef ESP8266
   #include <ESP8266WiFi.h>
-  #include <ESP8266HTTPClient.h>
 #endif
 #ifdef ESP32
   #include <WiFi.h>
-  #include <HTTPClient.h>
 #endif
-#include <ArduinoJson.h>
+#include <FS.h>
 #include "../config.h"
+#include <ArduinoJson.h>
+#include "Aggregate.h"
 
 
-#define MAX_PLUGINS 5
 
 // plugin states
 #define PLUGIN_IDLE 0
 #define PLUGIN_UPLOADING 1
 
-#define UUID_LENGTH 36
+// unsaved plugin state
+#define DIRTY_CONFIG 1
+#define DIRTY_TIMING 2
+
+#define UUID_LENGTH 36  // formatted
+#define UUID_SIZE 16    // binary
 #define JSON_NULL static_cast<const char*>(NULL)
 
+// uuids are kept in the plugin's packed uuid table
 struct DeviceStruct {
-  char uuid[UUID_LENGTH+1];
   float val;
 };
 
+// persisted per-sensor reporting settings
+struct SensorSettings {
+  float deadband;     // absolute deadband, 0 disabled
+  float relative;     // relative deadband in percent, 0 disabled
+  uint32_t heartbeat; // max silent interval in s, 0 disabled
+};
+
+// persisted plugin intervals
+struct PluginTiming {
+  uint32_t period;    // measurement and upload period in ms
+  uint32_t sample;    // sampling period in ms, 0 if plugin doesn't sample
+};
+
+// published sensor value, written from loop() and read via seqlock
+struct SensorValue {
+  volatile uint32_t seq; // odd while written
+  float val;
+  uint32_t timestamp;    // millis() at acquisition
+  uint64_t time;         // ms since epoch at acquisition, 0 if unknown
+  uint32_t generation;   // global generation of last publish
+  bool valid;
+};
+
+// runtime per-sensor reporting state
+struct SensorReport {
+  float val;          // last sent value
+  uint32_t timestamp; // last sent time
+  uint32_t sent;
+  uint32_t suppressed;
+};
+
+// runtime per-sensor health
+struct SensorHealth {
+  uint32_t lastSuccess;     // millis() of last valid reading, 0 if none
+  uint32_t reads;
+  uint32_t errors;          // invalid readings
+  uint16_t consecutive;     // invalid readings since last valid one
+  uint16_t latency;         // acquisition time of last reading in ms
+  uint32_t uploads;
+  uint32_t uploadErrors;
+  int16_t lastUploadError;  // HTTP status, negative on connection or mqtt error
+};
+
 class Plugin {
 public:
-  typedef std::function<void(Plugin*)> CallbackFunction;
-
-  Plugin(int8_t maxDevices, int8_t actualDevices);
+  Plugin(int16_t maxDevices, int16_t actualDevices);
   virtual ~Plugin();
-  static void each(CallbackFunction callback);
+
+  /**
+   * Iterate all plugins. Callback is inlined, capturing lambdas don't
+   * need a heap allocated std::function.
+   */
+  template<typename Callback>
+  static void each(Callback callback) {
+    for (Plugin* plugin = first; plugin; plugin = plugin->_next) {
+      callback(plugin);
+    }
+  }
+
+  /**
+   * Upload coordinator called from main loop(). Flushes all plugins with
+   * ready readings together at UPLOAD_WINDOW boundaries of the cycle clock,
+   * or as soon as no plugin is measuring if the device is going to sleep.
+   */
+  static void uploadReady(bool sleeping = false);
+
+  /**
+   * Upload readings of given plugins as one burst
+   */
+  static void uploadBurst(Plugin* const* plugins, uint8_t count);
+  static void getUploadJson(JsonObject* json);
+
+  /**
+   * Global generation counter, incremented whenever any plugin publishes
+   * a new reading
+   */
+  static uint32_t getGeneration();
+
+  /**
+   * Time from boot to first valid reading and first upload
+   */
+  static void getBootJson(JsonObject* json);
 
   /**
    * Get plugin name
@@ -44,51 +123,81 @@ public:
   /**
    * Get number of sensors for plugin
    */
-  virtual int8_t getSensors();
+  virtual int16_t getSensors();
 
   /**
    * Get sensor index by sensor name (e.g. /analog/<a0>)
    * Reversed by getAddr
    */
-  virtual int8_t getSensorByAddr(const char* addr_c);
+  virtual int16_t getSensorByAddr(const char* addr_c);
 
   /**
    * Get senor name by sensor index
    * Reversed by getSensorByAddr
    */
-  virtual bool getAddr(char* addr_c, int8_t sensor);
+  virtual bool getAddr(char* addr_c, int16_t sensor);
 
   /**
    * Get middleware entity UUID for sensor
    */
-  virtual bool getUuid(char* uuid_c, int8_t sensor);
+  virtual bool getUuid(char* uuid_c, int16_t sensor);
 
   /**
    * Set middleware entity UUID for sensor
    */
-  virtual bool setUuid(const char* uuid_c, int8_t sensor);
+  virtual bool setUuid(const char* uuid_c, int16_t sensor);
 
   /**
    * Get sensor hash value
    * Used to uniquely identify a sensor entity at the middleware even if
    * UUID has been erased from config
    */
-  virtual String getHash(int8_t sensor);
+  virtual String getHash(int16_t sensor);
+
+  /**
+   * Convert between formatted and binary UUID
+   */
+  static bool parseUuid(const char* uuid_c, uint8_t* uuid);
+  static void formatUuid(char* uuid_c, const uint8_t* uuid);
+
+  /**
+   * Get sensor reporting deadband and heartbeat
+   */
+  bool getSettings(SensorSettings* settings, int16_t sensor);
+
+  /**
+   * Set sensor reporting deadband and heartbeat
+   */
+  bool setSettings(const SensorSettings* settings, int16_t sensor);
+
+  /**
+   * Get consistent copy of last published sensor value. Safe to call
+   * from web server context, doesn't access hardware.
+   */
+  bool getSnapshot(SensorValue* value, int16_t sensor);
 
   /**
    * Get sensor value. Returns NAN is sensor not connected.
+   * Must only be called from loop().
    */
-  virtual float getValue(int8_t sensor);
+  virtual float getValue(int16_t sensor);
 
   /**
-   * Get plugin json inluding all sensors
+   * Copy sensor statistics of the last upload window. Returns false if
+   * plugin does not aggregate samples between uploads.
    */
-  virtual void getPluginJson(JsonObject* json);
+  virtual bool getAggregate(Aggregate* aggregate, int16_t sensor);
+
+  /**
+   * Get plugin json inluding all sensors, without details only sensor
+   * addresses and values are included
+   */
+  virtual void getPluginJson(JsonObject* json, bool details = true);
 
   /**
    * Get senor json
    */
-  virtual void getSensorJson(JsonObject* json, int8_t sensor);
+  virtual void getSensorJson(JsonObject* json, int16_t sensor, bool details = true);
 
   /**
    * Load plugin configuration
@@ -100,28 +209,115 @@ public:
    */
   virtual bool saveConfig();
 
+  /**
+   * Opt in to run loop() from the ESP32 sampling task. Plugin loop must not
+   * depend on main loop() state.
+   */
+  virtual bool isTaskSafe();
+
+  /**
+   * Write unsaved config and timing
+   */
+  void persist();
+
   /**
    * Plugin loop function called from main loop()
    */
   virtual void loop();
   virtual uint32_t getMaxSleepDuration();
 
+  /**
+   * Measurement period, readings are phase-aligned to multiples of the period
+   */
+  virtual uint32_t getPeriod();
+
+  /**
+   * Sensor warm-up time before reading (e.g. conversion or settling)
+   */
+  virtual uint32_t getWarmup();
+
+  /**
+   * Sampling period between measurements, 0 if plugin doesn't sample
+   */
+  uint32_t getSamplePeriod();
+
+  /**
+   * Minimum measurement period supported by the sensor
+   */
+  virtual uint32_t getMinPeriod();
+
+  /**
+   * Set measurement and sampling period, applied at the next period boundary
+   */
+  bool setTiming(uint32_t period, uint32_t sample);
+
 protected:
-  static HTTPClient http; // synchronous use only
   uint32_t _timestamp;
-  uint32_t _duration;
-  uint8_t _status;
-  int8_t _devs;
-  uint16_t _size;
+  uint32_t _sampleTimestamp;
+  uint32_t _readyTimestamp;
+  uint32_t _acquireTimestamp;
+  uint64_t _readingTime;  // acquisition time in ms since epoch, 0 if unknown
+  uint32_t _due;
+  // PLUGIN_UPLOADING hands the reading over to the uploader (upload task or
+  // uploadReady). Until it resets the status to PLUGIN_IDLE only the
+  // uploader uses the upload state (_readingTime, _reports, upload health)
+  // and the plugin loop doesn't change _status.
+  volatile uint8_t _status;
+  // handed to upload task, written by plugin loop or by the upload task
+  // while it holds the plugin, cleared when requeueing fails
+  volatile bool _queued;
+  int16_t _devs;
+  int16_t _maxDevs;
   DeviceStruct* _devices;
+  uint8_t* _uuids;        // binary uuids, UUID_SIZE per sensor
+  uint8_t* _uuidValid;    // validity bitmap
+  uint16_t _configSize;
+  SensorSettings* _settings;
+  SensorReport* _reports;
+  SensorValue* _values;
+  SensorHealth* _health;
+  PluginTiming _timing;
+  uint8_t _dirty;
+
+  void allocateSettings(int16_t maxDevices);
+  bool hasUuid(int16_t sensor);
+  bool storeUuid(int16_t sensor, const char* uuid_c);
+  int16_t readTable(File& file);
+  void clearTable(int16_t from);
+  size_t writeTable(File& file, int16_t count);
+  void publish(int16_t sensor, float val);
+  void readCompleted(int16_t sensor, float val);
+  void uploadCompleted(int16_t sensor, int status);
+  void initTiming(uint32_t period, uint32_t sample);
+  bool saveTiming();
+  void markDirty(uint8_t what);
+  bool isReportDue(int16_t sensor, float val);
+  void reported(int16_t sensor, float val);
 
+  virtual void ready();
+  virtual void record();
   virtual void upload();
   virtual bool isUploadSafe();
+  virtual bool due();
   virtual bool elapsed(uint32_t duration);
+  virtual bool sampleElapsed(uint32_t duration);
 
 private:
-  static int8_t instances;
-  static Plugin* plugins[];
+  // plugin registry
+  static Plugin* first;
+  static Plugin* last;
+  Plugin* _next;
+
+  // upload statistics
+  static uint32_t bursts;
+  static uint32_t uploads;
+  static uint32_t sent;
+  static uint32_t suppressed;
+
+  // published readings
+  static volatile uint32_t generation;
+  static uint32_t firstReading;
+  static uint32_t firstUpload;
 };
 
 #endif
@@ -38,6 +38,7 @@ S0Plugin* S0Plugin::_instance;
 
 S0Plugin::S0Plugin(int8_t pin) : Plugin(1, 1), _pin(pin) {
   loadConfig();
+  initTiming(SLEEP_PERIOD, 0);
 
   _instance = this;
   for (int i=0; i<sizeof(_power)/sizeof(_power[0]); i++)
@@ -53,23 +54,27 @@ S0Plugin::S0Plugin(int8_t pin) : Plugin(1, 1), _pin(pin) {
       attachInterrupt(pin, _s_interrupt14, FALLING);
       break;
     default:
-      DEBUG_MSG("s0", "panic: unsupported pin %d\n", pin);
-      PANIC();
+      // rejected by config validation
+      WARN_MSG("s0", "unsupported pin %d\n", pin);
   }
 }
 
+bool S0Plugin::isSupportedPin(int8_t pin) {
+  return pin == 12 || pin == 14;
+}
+
 String S0Plugin::getName() {
   return "s0";
 }
 
-int8_t S0Plugin::getSensorByAddr(const char* addr_c) {
+int16_t S0Plugin::getSensorByAddr(const char* addr_c) {
   String pin = PREFIX + String(_pin, 10);
   if (strcmp(addr_c, pin.c_str()) == 0)
     return 0;
   return -1;
 }
 
-bool S0Plugin::getAddr(char* addr_c, int8_t sensor) {
+bool S0Plugin::getAddr(char* addr_c, int16_t sensor) {
   if (sensor >= _devs)
     return false;
   String pin = PREFIX + String(_pin, 10);
@@ -77,7 +82,7 @@ bool S0Plugin::getAddr(char* addr_c, int8_t sensor) {
   return true;
 }
 
-float S0Plugin::getValue(int8_t sensor) {
+float S0Plugin::getValue(int16_t sensor) {
   uint16_t val = _power[sensor];
   return val;
 }
@@ -88,24 +93,21 @@ float S0Plugin::getValue(int8_t sensor) {
 void S0Plugin::loop() {
   Plugin::loop();
 
-  if (_status == PLUGIN_IDLE && elapsed(SLEEP_PERIOD)) {
-    _status = PLUGIN_UPLOADING;
-  }
-  if (_status == PLUGIN_UPLOADING) {
-    if (isUploadSafe()) {
-      upload();
-      _status = PLUGIN_IDLE;
-    }
+  if (_status == PLUGIN_IDLE && due()) {
+    String pwr = String(_power[_pin], 2);
+    DEBUG_MSG("s0", "pwr %sW %d\n", pwr.c_str(), _eventCnt[_pin]);
+    ready();
   }
 }
 
+/**
+ * Interrupt handler - must not log
+ */
 void S0Plugin::handleInterrupt(int8_t pin) {
   uint32_t ts = millis();
   _eventCnt[pin]++;
   if (_eventTs[pin] > 0) {
     _power[pin] = 1.0e6 / (ts - _eventTs[pin]);
-    String pwr = String(_power[pin], 2);
-    DEBUG_MSG("s0", "pwr %sW %d\n", pwr.c_str(), _eventCnt[pin]);
   }
   _eventTs[pin] = ts;
 }
@@ -4,13 +4,14 @@
 #include "Plugin.h"
 
 
-class S0Plugin : public Plugin {
+class S0Plugin final : public Plugin {
 public:
   S0Plugin(int8_t pin);
+  static bool isSupportedPin(int8_t pin);
   String getName() override;
-  int8_t getSensorByAddr(const char* addr_c) override;
-  bool getAddr(char* addr_c, int8_t sensor) override;
-  float getValue(int8_t sensor) override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
   void loop() override;
   void handleInterrupt(int8_t pin);
   static void _s_interrupt12();
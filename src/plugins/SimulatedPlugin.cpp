@@ -0,0 +1,135 @@
+#include "SimulatedPlugin.h"
+
+
+// plugin states
+#define PLUGIN_SETTLING PLUGIN_UPLOADING + 1
+
+#define SLEEP_PERIOD 10 * 1000
+#define PREFIX "sim"
+
+#define NOISE_ERROR_RATE 5  // percent of failed reads
+
+static const char* generatorNames[GENERATORS] = { "sine", "walk", "sawtooth", "noise" };
+
+
+/*
+ * Static
+ */
+
+int8_t SimulatedPlugin::getGenerator(const char* name) {
+  for (int8_t generator=0; name && generator<GENERATORS; generator++) {
+    if (strcmp(name, generatorNames[generator]) == 0)
+      return generator;
+  }
+  return -1;
+}
+
+const char* SimulatedPlugin::getGeneratorName(uint8_t generator) {
+  return (generator < GENERATORS) ? generatorNames[generator] : "";
+}
+
+
+/*
+ * Virtual
+ */
+
+SimulatedPlugin::SimulatedPlugin(int16_t sensors, uint32_t latency, uint8_t generators) : Plugin(sensors, sensors), _latency(latency), _generatorCount(0) {
+  for (uint8_t generator=0; generator<GENERATORS; generator++) {
+    if (generators & (1 << generator))
+      _generators[_generatorCount++] = generator;
+  }
+  if (_generatorCount == 0)
+    _generators[_generatorCount++] = GENERATOR_SINE;
+
+  DEBUG_MSG("sim", "%d sensors, %ums latency, %u generators\n", sensors, latency, _generatorCount);
+  loadConfig();
+  initTiming(SLEEP_PERIOD, 0);
+  for (int16_t i=0; i<_devs; i++)
+    _devices[i].val = 20.0;
+}
+
+String SimulatedPlugin::getName() {
+  return "sim";
+}
+
+int16_t SimulatedPlugin::getSensorByAddr(const char* addr_c) {
+  if (strncmp(addr_c, PREFIX, strlen(PREFIX)) != 0)
+    return -1;
+  int sensor = atoi(addr_c + strlen(PREFIX));
+  if (sensor < 0 || sensor >= _devs)
+    return -1;
+  return sensor;
+}
+
+bool SimulatedPlugin::getAddr(char* addr_c, int16_t sensor) {
+  if (sensor >= _devs)
+    return false;
+  sprintf(addr_c, PREFIX "%02d", sensor);
+  return true;
+}
+
+float SimulatedPlugin::getValue(int16_t sensor) {
+  if (sensor >= _devs)
+    return NAN;
+  return _devices[sensor].val;
+}
+
+bool SimulatedPlugin::isTaskSafe() {
+  return true;
+}
+
+uint32_t SimulatedPlugin::getWarmup() {
+  return _latency;
+}
+
+void SimulatedPlugin::getPluginJson(JsonObject* json, bool details) {
+  Plugin::getPluginJson(json, details);
+  if (!details)
+    return;
+  JsonObject& config = (*json)["settings"].as<JsonObject&>();
+  config[F("latency")] = _latency;
+  JsonArray& generators = config.createNestedArray("generators");
+  for (uint8_t i=0; i<_generatorCount; i++)
+    generators.add(generatorNames[_generators[i]]);
+}
+
+/**
+ * Next value of sensor, generator and phase depend on the sensor index
+ */
+float SimulatedPlugin::generate(int16_t sensor) {
+  float val = _devices[sensor].val;
+  if (isnan(val))
+    val = 20.0;
+
+  switch (_generators[sensor % _generatorCount]) {
+    case GENERATOR_SINE: {
+      // period between 1 and 16 minutes
+      uint32_t period = 60000 * (1 + (sensor / _generatorCount) % 16);
+      return 20.0 + 5.0 * sin(2 * PI * (millis() % period) / period);
+    }
+    case GENERATOR_WALK:
+      return val + random(-100, 101) / 100.0;
+    case GENERATOR_SAWTOOTH:
+      return (val >= 100.0) ? 0.0 : val + 1.0;
+    default:
+      if (random(100) < NOISE_ERROR_RATE)
+        return NAN;
+      return 20.0 + random(-50, 51) / 100.0;
+  }
+}
+
+/**
+ * Loop (idle -> settling -> uploading)
+ */
+void SimulatedPlugin::loop() {
+  Plugin::loop();
+
+  if (_status == PLUGIN_IDLE && due()) {
+    _status = PLUGIN_SETTLING;
+  }
+  else if (_status == PLUGIN_SETTLING && elapsed(_latency)) {
+    for (int16_t i=0; i<_devs; i++)
+      _devices[i].val = generate(i);
+    ready();
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef SIMULATED_PLUGIN_H
+#define SIMULATED_PLUGIN_H
+
+#include "Plugin.h"
+
+
+// generators
+#define GENERATOR_SINE 0
+#define GENERATOR_WALK 1
+#define GENERATOR_SAWTOOTH 2
+#define GENERATOR_NOISE 3
+#define GENERATORS 4
+#define GENERATORS_ALL ((1 << GENERATORS) - 1)
+
+
+/**
+ * Synthetic sensors for load testing without hardware. Sensors cycle
+ * through the enabled sine, random walk, sawtooth and noisy generators,
+ * the noisy generator occasionally fails to read.
+ */
+class SimulatedPlugin final : public Plugin {
+public:
+  SimulatedPlugin(int16_t sensors, uint32_t latency, uint8_t generators);
+
+  /**
+   * Generator by name, -1 if unknown
+   */
+  static int8_t getGenerator(const char* name);
+  static const char* getGeneratorName(uint8_t generator);
+
+  String getName() override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
+  void getPluginJson(JsonObject* json, bool details = true) override;
+  void loop() override;
+  bool isTaskSafe() override;
+  uint32_t getWarmup() override;
+
+protected:
+  uint32_t _latency;
+  uint8_t _generators[GENERATORS];  // enabled generators in sensor order
+  uint8_t _generatorCount;
+
+  float generate(int16_t sensor);
+};
+
+#endif
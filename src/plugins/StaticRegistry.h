@@ -0,0 +1,69 @@
+/**
+ * Static plugin registry
+ *
+ * Holds a fixed set of plugins in static storage instead of the heap.
+ * The loop calls each plugin's loop() non-virtually. The plugins still
+ * register with the dynamic registry, so Plugin::each() keeps working
+ * for web server, planner and uploads.
+ *
+ * Plugin construction is delegated to pluginCreate<T>(), which must be
+ * specialized for every plugin type used and returns NULL for plugins
+ * that are not enabled.
+ */
+#ifndef STATIC_REGISTRY_H
+#define STATIC_REGISTRY_H
+
+#include <new>
+#include <type_traits>
+#include "Plugin.h"
+#include "../tasks.h"
+
+
+template<typename T>
+T* pluginCreate(void* storage);
+
+template<typename... Plugins>
+class StaticRegistry {
+public:
+  static void begin() {
+    (void)expand{ 0, (create<Plugins>(), 0)... };
+  }
+
+  static void loop() {
+    (void)expand{ 0, (loopPlugin<Plugins>(), 0)... };
+  }
+
+private:
+  // pack expansion without C++17 fold expressions
+  typedef int expand[sizeof...(Plugins) + 1];
+
+  template<typename T>
+  struct Slot {
+    static typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    static T* plugin;
+  };
+
+  template<typename T>
+  static void create() {
+    Slot<T>::plugin = pluginCreate<T>(&Slot<T>::storage);
+  }
+
+  template<typename T>
+  static void loopPlugin() {
+    if (Slot<T>::plugin == NULL || tasks_owns(Slot<T>::plugin))
+      return;
+    // qualified call bypasses the vtable
+    Slot<T>::plugin->T::loop();
+    yield();
+  }
+};
+
+template<typename... Plugins>
+template<typename T>
+typename std::aligned_storage<sizeof(T), alignof(T)>::type StaticRegistry<Plugins...>::Slot<T>::storage;
+
+template<typename... Plugins>
+template<typename T>
+T* StaticRegistry<Plugins...>::Slot<T>::plugin = NULL;
+
+#endif
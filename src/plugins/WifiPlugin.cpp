@@ -2,6 +2,7 @@
 
 
 #define SLEEP_PERIOD 10 * 1000
+#define SAMPLE_PERIOD 500
 
 
 /*
@@ -10,42 +11,59 @@
 
 WifiPlugin::WifiPlugin() : Plugin(1, 1) {
   loadConfig();
+  initTiming(SLEEP_PERIOD, SAMPLE_PERIOD);
+  _devices[0].val = NAN;
 }
 
 String WifiPlugin::getName() {
   return "wifi";
 }
 
-int8_t WifiPlugin::getSensorByAddr(const char* addr_c) {
+int16_t WifiPlugin::getSensorByAddr(const char* addr_c) {
   if (strcmp(addr_c, "wlan") == 0)
     return 0;
   return -1;
 }
 
-bool WifiPlugin::getAddr(char* addr_c, int8_t sensor) {
+bool WifiPlugin::getAddr(char* addr_c, int16_t sensor) {
   if (sensor >= _devs)
     return false;
   strcpy(addr_c, "wlan");
   return true;
 }
 
-float WifiPlugin::getValue(int8_t sensor) {
-  return WiFi.RSSI();
+float WifiPlugin::getValue(int16_t sensor) {
+  if (sensor >= _devs)
+    return NAN;
+  return _devices[sensor].val;
+}
+
+bool WifiPlugin::getAggregate(Aggregate* aggregate, int16_t sensor) {
+  if (sensor >= _devs)
+    return false;
+  _window.read(aggregate);
+  return true;
+}
+
+bool WifiPlugin::isTaskSafe() {
+  return true;
 }
 
 /**
- * Loop (idle -> uploading)
+ * Loop (sampling, idle -> uploading)
  */
 void WifiPlugin::loop() {
   Plugin::loop();
 
-  if (_status == PLUGIN_IDLE && elapsed(SLEEP_PERIOD)) {
-    _status = PLUGIN_UPLOADING;
+  if (sampleElapsed(_timing.sample)) {
+    _aggregate.add(WiFi.RSSI());
   }
-  if (_status == PLUGIN_UPLOADING) {
-    if (isUploadSafe()) {
-      upload();
-      _status = PLUGIN_IDLE;
-    }
+
+  if (_status == PLUGIN_IDLE && due()) {
+    // close window, upload window mean
+    _window.publish(_aggregate);
+    _devices[0].val = _aggregate.mean();
+    _aggregate.reset();
+    ready();
   }
 }
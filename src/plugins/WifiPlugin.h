@@ -4,14 +4,20 @@
 #include "Plugin.h"
 
 
-class WifiPlugin : public Plugin {
+class WifiPlugin final : public Plugin {
 public:
   WifiPlugin();
   String getName() override;
-  int8_t getSensorByAddr(const char* addr_c) override;
-  bool getAddr(char* addr_c, int8_t sensor) override;
-  float getValue(int8_t sensor) override;
+  int16_t getSensorByAddr(const char* addr_c) override;
+  bool getAddr(char* addr_c, int16_t sensor) override;
+  float getValue(int16_t sensor) override;
+  bool getAggregate(Aggregate* aggregate, int16_t sensor) override;
   void loop() override;
+  bool isTaskSafe() override;
+
+protected:
+  Aggregate _aggregate;    // current window
+  AggregateWindow _window; // last completed window
 };
 
 #endif
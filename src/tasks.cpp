@@ -0,0 +1,131 @@
+/**
+ * ESP32 task layout
+ */
+
+#include "tasks.h"
+
+#if defined(ESP32) && defined(ESP32_TASKS)
+
+#include "plugins/Plugin.h"
+#include "planner.h"
+
+
+#define SAMPLING_CORE 1       // application core, shared with loop()
+#define UPLOAD_CORE 0         // protocol core, runs WiFi and lwIP
+#define SAMPLING_STACK 4096
+#define UPLOAD_STACK 8192
+#define UPLOAD_QUEUE_SIZE 8
+
+struct TaskStats {
+  TaskHandle_t handle;
+  uint8_t core;
+  uint32_t busyUs;            // time spent working
+};
+
+static QueueHandle_t _uploads = NULL;
+static TaskStats _sampling = {};
+static TaskStats _uploader = {};
+static TaskHandle_t _loop = NULL;
+static uint32_t _queueFull = 0;
+
+
+void samplingTask(void* param)
+{
+  for (;;) {
+    uint32_t start = micros();
+    Plugin::each([](Plugin* plugin) {
+      if (plugin->isTaskSafe())
+        plugin->loop();
+    });
+    _sampling.busyUs += micros() - start;
+
+    vTaskDelay(pdMS_TO_TICKS(LOOP_DELAY));
+  }
+}
+
+/**
+ * Collect ready plugins until the next aligned upload window, then upload
+ * them as one burst
+ */
+void uploadTask(void* param)
+{
+  Plugin* batch[UPLOAD_QUEUE_SIZE];
+
+  for (;;) {
+    if (xQueueReceive(_uploads, &batch[0], portMAX_DELAY) != pdTRUE)
+      continue;
+
+    // next window boundary of the cycle clock, like uploadReady()
+    uint32_t remaining = planner_next(UPLOAD_WINDOW, 0) - planner_millis();
+    uint32_t deadline = millis() + min(remaining, (uint32_t)(UPLOAD_MAX_LATENCY));
+
+    uint8_t count = 1;
+    int32_t wait;
+    while (count < UPLOAD_QUEUE_SIZE && (wait = deadline - millis()) > 0) {
+      if (xQueueReceive(_uploads, &batch[count], pdMS_TO_TICKS(wait)) == pdTRUE)
+        count++;
+    }
+
+    uint32_t start = micros();
+    Plugin::uploadBurst(batch, count);
+    _uploader.busyUs += micros() - start;
+  }
+}
+
+void tasks_start()
+{
+  _uploads = xQueueCreate(UPLOAD_QUEUE_SIZE, sizeof(Plugin*));
+  if (_uploads == NULL) {
+    ERROR_MSG(TASKS, "failed creating upload queue\n");
+    return;
+  }
+
+  _loop = xTaskGetCurrentTaskHandle();
+  _sampling.core = SAMPLING_CORE;
+  _uploader.core = UPLOAD_CORE;
+  xTaskCreatePinnedToCore(samplingTask, "sampling", SAMPLING_STACK, NULL, 1, &_sampling.handle, SAMPLING_CORE);
+  xTaskCreatePinnedToCore(uploadTask, "upload", UPLOAD_STACK, NULL, 1, &_uploader.handle, UPLOAD_CORE);
+  DEBUG_MSG(TASKS, "sampling on core %d, upload on core %d\n", SAMPLING_CORE, UPLOAD_CORE);
+}
+
+bool tasks_running()
+{
+  return _uploads != NULL;
+}
+
+bool tasks_owns(Plugin* plugin)
+{
+  return tasks_running() && plugin->isTaskSafe();
+}
+
+bool tasks_queueUpload(Plugin* plugin)
+{
+  if (xQueueSend(_uploads, &plugin, 0) == pdTRUE)
+    return true;
+  _queueFull++;
+  return false;
+}
+
+void getTaskJson(JsonObject* json, TaskStats* task)
+{
+  (*json)[F("core")] = task->core;
+  (*json)[F("cpu")] = task->busyUs / 10.0 / millis(); // percent
+  (*json)[F("stackfree")] = uxTaskGetStackHighWaterMark(task->handle);
+}
+
+void tasks_getJson(JsonObject* json)
+{
+  if (!tasks_running())
+    return;
+
+  JsonObject& sampling = json->createNestedObject("sampling");
+  getTaskJson(&sampling, &_sampling);
+  JsonObject& upload = json->createNestedObject("upload");
+  getTaskJson(&upload, &_uploader);
+
+  (*json)[F("loopstackfree")] = uxTaskGetStackHighWaterMark(_loop);
+  (*json)[F("queued")] = uxQueueMessagesWaiting(_uploads);
+  (*json)[F("queuefull")] = _queueFull;
+}
+
+#endif
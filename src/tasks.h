@@ -0,0 +1,62 @@
+/**
+ * ESP32 task layout
+ *
+ * With ESP32_TASKS plugins that opt in via Plugin::isTaskSafe() are
+ * sampled by a task on the application core, while uploads run in a
+ * task on the protocol core next to the WiFi stack. Ready plugins are
+ * handed to the uploader through a bounded queue, so blocking uploads
+ * never delay sampling. Without ESP32_TASKS, and on ESP8266, everything
+ * runs from loop().
+ *
+ * A plugin belongs to its loop context until it is ready. From then on
+ * the upload task owns it until the upload resets it to idle. Readings
+ * that find the queue full or can't be uploaded stay pending and are
+ * queued again. Config writes (flushConfig) only read the plugin tables.
+ */
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define TASKS "tasks"	// module name
+
+class Plugin;
+
+#if defined(ESP32) && defined(ESP32_TASKS)
+
+/**
+ * Start sampling and upload tasks
+ */
+void tasks_start();
+
+/**
+ * True if tasks are running
+ */
+bool tasks_running();
+
+/**
+ * True if plugin loop is run by the sampling task instead of loop()
+ */
+bool tasks_owns(Plugin* plugin);
+
+/**
+ * Queue ready plugin for upload, false if queue full
+ */
+bool tasks_queueUpload(Plugin* plugin);
+
+void tasks_getJson(JsonObject* json);
+
+#else
+
+inline void tasks_start() {}
+inline bool tasks_running() { return false; }
+inline bool tasks_owns(Plugin* plugin) { return false; }
+inline bool tasks_queueUpload(Plugin* plugin) { return false; }
+
+#endif
+
+#endif
@@ -0,0 +1,330 @@
+/**
+ * Firmware update client
+ */
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#include <Updater.h>
+#include <BearSSLHelpers.h>
+#define UPDATE_PLATFORM "esp8266"
+#endif
+
+#ifdef ESP32
+#include <WiFi.h>
+#include <Update.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+#define UPDATE_PLATFORM "esp32"
+#endif
+
+#include "update.h"
+#include "manifest.h"
+#include "webserver.h"
+
+
+#define ERROR_CONNECT -1
+#define ERROR_READ -2
+#define ERROR_MANIFEST -3
+#define ERROR_SIGNATURE -4
+#define ERROR_HASH -5
+#define ERROR_UPDATER 1000    // plus updater error code
+
+static uint32_t _checked = 0;
+static uint32_t _due = 0;       // scheduled install, 0 if none
+
+// pending update from manifest
+static String _version = "";
+static String _image = "";
+static String _sha256 = "";
+
+// statistics
+static uint32_t _checks = 0;
+static uint32_t _installs = 0;
+static uint32_t _errors = 0;
+static int _lastError = 0;
+static uint32_t _downloadMs = 0;
+
+
+/**
+ * Incremental SHA-256
+ */
+class Sha256 {
+public:
+#ifdef ESP8266
+  Sha256() { _hash.begin(); }
+  void add(const void* data, size_t len) { _hash.add(data, len); }
+  void finish(uint8_t* digest) { _hash.end(); memcpy(digest, _hash.hash(), SHA256_SIZE); }
+
+private:
+  BearSSL::HashSHA256 _hash;
+#endif
+#ifdef ESP32
+  Sha256() { mbedtls_sha256_init(&_ctx); mbedtls_sha256_starts(&_ctx, 0); }
+  ~Sha256() { mbedtls_sha256_free(&_ctx); }
+  void add(const void* data, size_t len) { mbedtls_sha256_update(&_ctx, (const uint8_t*)data, len); }
+  void finish(uint8_t* digest) { mbedtls_sha256_finish(&_ctx, digest); }
+
+private:
+  mbedtls_sha256_context _ctx;
+#endif
+};
+
+/**
+ * Verify RSA PKCS#1 v1.5 SHA-256 signature of message against
+ * UPDATE_PUBLIC_KEY, every signature is rejected without key
+ */
+static bool verifySignature(const String& message, const uint8_t* signature, size_t length)
+{
+#if !defined(UPDATE_PUBLIC_KEY)
+  return false;
+#elif defined(ESP8266)
+  BearSSL::PublicKey key(UPDATE_PUBLIC_KEY);
+  BearSSL::SigningVerifier verifier(&key);
+  BearSSL::HashSHA256 hash;
+  hash.begin();
+  hash.add(message.c_str(), message.length());
+  hash.end();
+  return verifier.verify(&hash, signature, length);
+#elif defined(ESP32)
+  uint8_t digest[SHA256_SIZE];
+  Sha256 hash;
+  hash.add(message.c_str(), message.length());
+  hash.finish(digest);
+
+  // pem length includes the terminating null
+  mbedtls_pk_context key;
+  mbedtls_pk_init(&key);
+  bool valid = mbedtls_pk_parse_public_key(&key, (const uint8_t*)UPDATE_PUBLIC_KEY, sizeof(UPDATE_PUBLIC_KEY)) == 0 &&
+    mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, digest, sizeof(digest), signature, length) == 0;
+  mbedtls_pk_free(&key);
+  return valid;
+#endif
+}
+
+/**
+ * Send GET request to http://host[:port]/path and read response headers,
+ * returns HTTP status or negative value on error
+ */
+static int get(WiFiClient& client, const String& url, int32_t* length)
+{
+  if (!url.startsWith("http://")) {
+    ERROR_MSG(UPDATE, "unsupported url %s\n", url.c_str());
+    return ERROR_CONNECT;
+  }
+
+  int slash = url.indexOf('/', 7);
+  String host = (slash >= 0) ? url.substring(7, slash) : url.substring(7);
+  String path = (slash >= 0) ? url.substring(slash) : "/";
+  int colon = host.indexOf(':');
+  uint16_t port = (colon >= 0) ? host.substring(colon + 1).toInt() : 80;
+  if (colon >= 0)
+    host = host.substring(0, colon);
+
+  if (!client.connect(host.c_str(), port)) {
+    WARN_MSG(UPDATE, "connect to %s:%d failed\n", host.c_str(), port);
+    return ERROR_CONNECT;
+  }
+  client.setTimeout(UPDATE_TIMEOUT);
+
+  // HTTP/1.0 avoids chunked responses
+  String request = "GET " + path + F(" HTTP/1.0\r\nHost: ") + host + F("\r\n\r\n");
+  client.write((const uint8_t*)request.c_str(), request.length());
+
+  String line = client.readStringUntil('\n');
+  if (!line.startsWith("HTTP/1."))
+    return ERROR_READ;
+  int code = line.substring(9, 12).toInt();
+
+  *length = -1;
+  while (client.connected() || client.available()) {
+    line = client.readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0)
+      break;
+    line.toLowerCase();
+    if (line.startsWith("content-length:"))
+      *length = line.substring(15).toInt();
+  }
+
+  return code;
+}
+
+static void failed(int error)
+{
+  ERROR_MSG(UPDATE, "failed [%d]\n", error);
+  _errors++;
+  _lastError = error;
+}
+
+/**
+ * Load manifest and schedule install if newer than running version
+ */
+static void check()
+{
+  _checks++;
+
+  WiFiClient client;
+  int32_t length;
+  int code = get(client, g_updateServer + F("/" UPDATE_PLATFORM ".json"), &length);
+  if (code != 200 || length <= 0 || length > UPDATE_MANIFEST_SIZE) {
+    failed((code == 200) ? ERROR_MANIFEST : code);
+    return;
+  }
+
+  std::unique_ptr<char[]> buf(new char[length + 1]);
+  if (client.readBytes(buf.get(), length) != (size_t)length) {
+    failed(ERROR_READ);
+    return;
+  }
+  buf[length] = '\0';
+  client.stop();
+
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject& json = jsonBuffer.parseObject(buf.get());
+  Manifest manifest;
+  manifest.version = json["version"];
+  manifest.image = json["image"];
+  manifest.sha256 = json["sha256"];
+  manifest.signature = json["signature"];
+  if (!json.success() || !manifest_valid(&manifest)) {
+    failed(ERROR_MANIFEST);
+    return;
+  }
+
+  if (manifest_compareVersions(manifest.version, BUILD) <= 0) {
+    _due = 0;
+    return;
+  }
+
+  // signature covers everything installed, the window only affects timing
+  std::unique_ptr<uint8_t[]> sig(new uint8_t[SIGNATURE_MAX_SIZE]);
+  size_t sigLength = manifest_signature(&manifest, sig.get(), SIGNATURE_MAX_SIZE);
+  String message = String(manifest.version) + "\n" + manifest.image + "\n" + manifest.sha256;
+  if (sigLength == 0 || !verifySignature(message, sig.get(), sigLength)) {
+    failed(ERROR_SIGNATURE);
+    return;
+  }
+
+  // new version or image - (re)schedule within rollout window
+  if (_version != manifest.version || _image != manifest.image || _sha256 != manifest.sha256 || _due == 0) {
+    _version = manifest.version;
+    _image = manifest.image;
+    _sha256 = manifest.sha256;
+
+    uint32_t window = json.containsKey("window") ? json["window"] : UPDATE_WINDOW;
+    uint32_t offset = manifest_offset(getChipId(), window);
+    _due = millis() + offset * 1000;
+    if (_due == 0)
+      _due = 1;
+    INFO_MSG(UPDATE, "version %s available, install in %us\n", _version.c_str(), offset);
+  }
+}
+
+/**
+ * Download image into flash, restart on success
+ */
+static void install()
+{
+  String url = (_image.startsWith("http://")) ? _image : g_updateServer + "/" + _image;
+  DEBUG_MSG(UPDATE, "installing %s\n", url.c_str());
+
+  // the download blocks plugins and uploads, persist state first
+  flushConfig(true);
+  log_flush();
+
+  uint32_t start = millis();
+  WiFiClient client;
+  int32_t length;
+  int code = get(client, url, &length);
+  if (code != 200 || length <= 0) {
+    failed((code == 200) ? ERROR_READ : code);
+    return;
+  }
+
+  // compressed images are stored as is and unpacked by the ESP8266 bootloader
+  if (!Update.begin(length)) {
+    failed(ERROR_UPDATER + Update.getError());
+    return;
+  }
+
+  // the last chunk is held back until the image hash is verified
+  Sha256 hash;
+  uint8_t buf[UPDATE_BUFFER_SIZE];
+  size_t n = 0;
+  int32_t remaining = length;
+  while (remaining > 0 && millis() - start < UPDATE_INSTALL_TIMEOUT) {
+    n = client.readBytes(buf, min(remaining, (int32_t)sizeof(buf)));
+    if (n == 0)
+      break;
+    yield();
+    hash.add(buf, n);
+    remaining -= n;
+    if (remaining > 0 && Update.write(buf, n) != n)
+      break;
+  }
+
+  uint8_t digest[SHA256_SIZE];
+  uint8_t expected[SHA256_SIZE];
+  hash.finish(digest);
+  manifest_parseHex(_sha256.c_str(), expected, sizeof(expected));
+
+  int error = 0;
+  if (Update.hasError())
+    error = ERROR_UPDATER + Update.getError();
+  else if (remaining > 0)
+    error = ERROR_READ;
+  else if (memcmp(digest, expected, sizeof(digest)) != 0)
+    error = ERROR_HASH;
+  else if (Update.write(buf, n) != n)
+    error = ERROR_UPDATER + Update.getError();
+
+  // end() discards incomplete images
+  if (!Update.end() && error == 0)
+    error = ERROR_UPDATER + Update.getError();
+  if (error) {
+    failed(error);
+    return;
+  }
+
+  _installs++;
+  _downloadMs = millis() - start;
+  INFO_MSG(UPDATE, "installed %s in %ums\n", _version.c_str(), _downloadMs);
+
+  // restart through loop() to flush config and log
+  g_restartTime = millis() + 100;
+}
+
+void update_loop()
+{
+  if (g_updateServer == "" || WiFi.status() != WL_CONNECTED || g_restartTime > 0)
+    return;
+
+  uint32_t now = millis();
+  if (_due && (int32_t)(now - _due) >= 0) {
+    _due = 0;
+    install();
+    return;
+  }
+
+  if (now - _checked >= ((_checks) ? UPDATE_CHECK_INTERVAL : UPDATE_CHECK_DELAY)) {
+    _checked = now;
+    check();
+  }
+}
+
+void update_getJson(JsonObject* json)
+{
+  (*json)[F("server")] = g_updateServer;
+  if (_version != "") {
+    (*json)[F("available")] = _version;
+    if (_due)
+      (*json)[F("due")] = (int32_t)(_due - millis()) / 1000;
+  }
+  (*json)[F("checks")] = _checks;
+  (*json)[F("installs")] = _installs;
+  (*json)[F("errors")] = _errors;
+  if (_errors)
+    (*json)[F("lasterror")] = _lastError;
+  if (_installs)
+    (*json)[F("downloadms")] = _downloadMs;
+}
@@ -0,0 +1,34 @@
+/**
+ * Firmware update client
+ *
+ * Periodically pulls a manifest from the update server configured in
+ * config.json and installs newer firmware than BUILD. The manifest is
+ * signed with the key matching UPDATE_PUBLIC_KEY (RSA PKCS#1 v1.5, SHA-256
+ * over "<version>\n<image>\n<sha256>"), the image is verified against the
+ * signed SHA-256 before activation. Images may be gzip compressed on
+ * ESP8266 only. Devices delay installation by a chip-id derived offset
+ * within the rollout window so a fleet doesn't download at the same time.
+ *
+ * Manifest <server>/<platform>.json, sha256 and signature hex encoded:
+ *   {"version":"0.4.1","image":"vzero-0.4.1.bin.gz","sha256":"...",
+ *    "signature":"...","window":3600}
+ */
+
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#include <ArduinoJson.h>
+
+#define UPDATE "update"	// module name
+
+/**
+ * Check for and install updates when due, call from loop()
+ */
+void update_loop();
+
+void update_getJson(JsonObject* json);
+
+#endif
@@ -19,17 +19,18 @@
 
 #include "config.h"
 #include "webserver.h"
+#include "mqtt.h"
+#include "planner.h"
+#include "clock.h"
+#include "network.h"
+#include "update.h"
+#include "tasks.h"
 #include "plugins/Plugin.h"
 
 #ifdef OTA_SERVER
 #include <ArduinoOTA.h>
 #endif
 
-#ifdef CAPTIVE_PORTAL
-#include <DNSServer.h>
-const byte DNS_PORT = 53;
-DNSServer dnsServer;
-#endif
 
 enum operation_t {
   OPERATION_NORMAL = 0, // deep sleep forbidden
@@ -57,20 +58,6 @@ operation_t getOperationMode()
   return OPERATION_SLEEP;
 }
 
-/**
- * (Re)connect WiFi - give ESP 10 seconds to connect to station
- */
-wl_status_t wifiConnect() {
-  DEBUG_MSG("wifi", "waiting for connection");
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - startTime < WIFI_CONNECT_TIMEOUT) {
-    DEBUG_PLAIN(".");
-    delay(100);
-  }
-  DEBUG_PLAIN("\n");
-  return WiFi.status();
-}
-
 /**
  * Get max deep sleep window in ms
  */
@@ -79,8 +66,8 @@ uint32_t getDeepSleepDurationMs()
 #ifndef DEEP_SLEEP
   return 0;
 #else
-  // don't sleep if access point
-  if ((WiFi.getMode() & WIFI_STA) == 0)
+  // don't sleep if access point or before connected
+  if ((WiFi.getMode() & WIFI_STA) == 0 || network_state() == NETWORK_CONNECTING)
     return 0;
   // don't sleep during initial startup
   if (g_resetInfo->reason != 5 && millis() < STARTUP_ONLINE_DURATION_MS)
@@ -90,6 +77,7 @@ uint32_t getDeepSleepDurationMs()
     return 0;
 
   // check if deep sleep possible
+  // plugin periods are phase-aligned by the planner, wake up before warm-up
   uint32_t maxSleep = -1; // max uint32_t
   Plugin::each([&maxSleep](Plugin* plugin) {
     uint32_t sleep = plugin->getMaxSleepDuration();
@@ -115,7 +103,7 @@ void start_ota() {
     DEBUG_MSG(CORE, "mDNS responder started at %s.local\n", net_hostname.c_str());
   }
   else {
-    DEBUG_MSG(CORE, "error setting up mDNS responder\n");
+    WARN_MSG(CORE, "error setting up mDNS responder\n");
   }
 
   // start OTA server
@@ -141,7 +129,7 @@ void start_ota() {
     }
   });
   ArduinoOTA.onError([](ota_error_t error) {
-    DEBUG_MSG(CORE, "OTA error [%u]\n", error);
+    ERROR_MSG(CORE, "OTA error [%u]\n", error);
   });
   ArduinoOTA.begin();
 #endif
@@ -171,7 +159,7 @@ void setup()
 
   DEBUG_PLAIN("\n");
   DEBUG_MSG(CORE, "Booting...\n");
-  DEBUG_MSG(CORE, "Cause %d:    %s\n", getResetReason(0), getResetReasonStr(0));
+  INFO_MSG(CORE, "Cause %d:    %s\n", getResetReason(0), getResetReasonStr(0));
   DEBUG_MSG(CORE, "Chip ID:    %05X\n", getChipId());
 
 #ifndef ESP32
@@ -181,57 +169,27 @@ void setup()
   DEBUG_MSG(CORE, "Hostname:   %s\n", net_hostname.c_str());
 #endif
 
+  // restore cycle clock
+  planner_start();
+
   // initialize file system
   if (!SPIFFS.begin()) {
-    DEBUG_MSG(CORE, "failed mounting file system\n");
+    ERROR_MSG(CORE, "failed mounting file system\n");
     return;
   }
 
-  // check WiFi connection
-  if (WiFi.getMode() != WIFI_STA) {
-    WiFi.mode(WIFI_STA);
-    delay(10);
-  }
-
-  // configuration changed - set new credentials
-  if (loadConfig() && g_ssid != "" && (String(WiFi.SSID()) != g_ssid || String(WiFi.psk()) != g_pass)) {
-    DEBUG_MSG("wifi", "connect:    %s\n", WiFi.SSID().c_str());
-    WiFi.begin(g_ssid.c_str(), g_pass.c_str());
-  }
-  else {
-    // reconnect to sdk-configured station
-    DEBUG_MSG("wifi", "reconnect:  %s\n", WiFi.SSID().c_str());
-    WiFi.begin();
-  }
-
-  // Check connection
-  if (wifiConnect() == WL_CONNECTED) {
-    DEBUG_MSG("wifi", "IP address: %d.%d.%d.%d\n", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
-  }
-  else {
-    // go into AP mode
-    DEBUG_MSG("wifi", "could not connect to WiFi - going into AP mode\n");
-
-    WiFi.mode(WIFI_AP); // WIFI_AP_STA
-    delay(10);
-
-    WiFi.softAP(ap_default_ssid);
-    DEBUG_MSG("wifi", "IP address: %d.%d.%d.%d\n", WiFi.softAPIP()[0], WiFi.softAPIP()[1], WiFi.softAPIP()[2], WiFi.softAPIP()[3]);
-
-#ifdef CAPTIVE_PORTAL
-    // start DNS server for any domain
-    DEBUG_MSG("wifi", "starting captive DNS server\n");
-    dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
-#endif
-  }
+  // associate in background while plugins start
+  loadConfig();
+  network_start();
 
-  // start OTA - both in AP as in STA mode
-  if (getOperationMode() == OPERATION_NORMAL) {
-    start_ota();
+  // start mqtt transport, connects once WiFi is up
+  if (g_transport == TRANSPORT_MQTT) {
+    mqtt_start();
   }
 
   // start plugins (before web server)
   startPlugins();
+  tasks_start();
 
   // start web server if not in battery mode
   if (getOperationMode() == OPERATION_NORMAL) {
@@ -252,9 +210,14 @@ void loop()
   // loop duration
   _tsMillis = millis();
 
-#ifdef CAPTIVE_PORTAL
-  dnsServer.processNextRequest();
-#endif
+  // start network services once connected or in AP mode
+  if (network_loop()) {
+    if (network_state() == NETWORK_CONNECTED)
+      clock_start();
+    // start OTA - both in AP as in STA mode
+    if (getOperationMode() == OPERATION_NORMAL)
+      start_ota();
+  }
 
 #ifdef OTA_SERVER
   if (getOperationMode() == OPERATION_NORMAL) {
@@ -262,38 +225,55 @@ void loop()
   }
 #endif
 
-  // call plugin's loop method
-  Plugin::each([](Plugin* plugin) {
-    plugin->loop();
-    yield();
-  });
+  // wall clock sync
+  clock_loop();
+
+  // mqtt reconnect
+  if (g_transport == TRANSPORT_MQTT) {
+    mqtt_loop();
+  }
+
+  // call plugin's loop method, average cycles per loop
+  uint32_t cycles = ESP.getCycleCount();
+  loopPlugins();
+  cycles = ESP.getCycleCount() - cycles;
+  g_pluginCycles = (g_pluginCycles) ? (g_pluginCycles * 15 + cycles) / 16 : cycles;
+
+  // upload ready readings, unless done by upload task
+  if (!tasks_running()) {
+    Plugin::uploadReady(getOperationMode() == OPERATION_SLEEP);
+  }
+
+  // write settled config changes
+  flushConfig();
+
+  // pull firmware updates
+  if (getOperationMode() == OPERATION_NORMAL) {
+    update_loop();
+  }
+
+  // drain log buffer
+  log_loop();
 
   // check if deep sleep possible
   uint32_t sleep = getDeepSleepDurationMs();
   if (sleep > 0) {
     DEBUG_MSG(CORE, "going to deep sleep for %ums\n", sleep);
+    planner_sleep(sleep);
+    flushConfig(true);
+    log_flush();
     ESP.deepSleep(sleep * 1000);
   }
 
   // trigger restart?
   if (g_restartTime > 0 && millis() >= g_restartTime) {
-    DEBUG_MSG(CORE, "restarting...\n");
+    INFO_MSG(CORE, "restarting...\n");
     g_restartTime = 0;
+    flushConfig(true);
+    log_flush();
     ESP.restart();
   }
 
-  // check WLAN if not AP
-  if ((WiFi.getMode() & WIFI_AP) == 0) {
-    if (WiFi.status() != WL_CONNECTED) {
-      DEBUG_MSG(CORE, "wifi connection lost\n");
-      WiFi.reconnect();
-      if (wifiConnect() != WL_CONNECTED) {
-        DEBUG_MSG(CORE, "could not reconnect wifi - restarting\n");
-        ESP.restart();
-      }
-    }
-  }
-
   // loop duration without debug
   _loopMillis = millis() - _tsMillis;
 
@@ -315,5 +295,5 @@ void loop()
     DEBUG_MSG(CORE, "loop %ums\n", _loopMillis);
   }
 
-  delay(1000);
+  delay(LOOP_DELAY);
 }
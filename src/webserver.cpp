@@ -4,13 +4,23 @@
 
 #include <Arduino.h>
 #include <FS.h>
+#include "config.h"
+
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <AsyncJson.h>
 
-#include "config.h"
 #include "webserver.h"
 #include "urlfunctions.h"
+#include "history.h"
+#include "mqtt.h"
+#include "middleware.h"
+#include "planner.h"
+#include "clock.h"
+#include "network.h"
+#include "update.h"
+#include "tasks.h"
+#include "cbor.h"
 #include "plugins/Plugin.h"
 
 #ifdef ESP8266
@@ -29,6 +39,7 @@
 
 #define CACHE_HEADER "max-age=86400"
 #define CORS_HEADER "Access-Control-Allow-Origin"
+#define EXPOSE_HEADER "Access-Control-Expose-Headers"
 
 #define CONTENT_TYPE_JSON "application/json"
 #define CONTENT_TYPE_PLAIN "text/plain"
@@ -39,20 +50,48 @@ uint32_t g_lastAccessTime = 0;
 
 AsyncWebServer g_server(80);
 
+// response encoding statistics, json and cbor
+struct EncodingStats {
+  uint32_t responses;
+  uint32_t bytes;
+  uint32_t us;
+};
+
+static EncodingStats g_encoding[2] = {};
+
+// random per boot, generations restart at 0 after reset or deep sleep
+static uint32_t g_bootId = 0;
+
 
 void requestRestart()
 {
   g_restartTime = millis() + 100;
 }
 
-void jsonResponse(AsyncWebServerRequest *request, int res, JsonVariant json)
+/**
+ * Send json tree, encoded as CBOR if accepted by client
+ */
+void jsonResponse(AsyncWebServerRequest *request, int res, JsonVariant json, const char* etag = NULL)
 {
   // touch
   g_lastAccessTime = millis();
 
-  AsyncResponseStream *response = request->beginResponseStream(F(CONTENT_TYPE_JSON));
+  bool cbor = request->hasHeader("Accept") && request->getHeader("Accept")->value().indexOf(F(CONTENT_TYPE_CBOR)) >= 0;
+
+  AsyncResponseStream *response = request->beginResponseStream(cbor ? F(CONTENT_TYPE_CBOR) : F(CONTENT_TYPE_JSON));
+  response->setCode(res);
   response->addHeader(F(CORS_HEADER), "*");
-  json.printTo(*response);
+  if (etag) {
+    response->addHeader(F("ETag"), etag);
+    response->addHeader(F(EXPOSE_HEADER), F("ETag"));
+  }
+
+  uint32_t start = micros();
+  EncodingStats* stats = &g_encoding[cbor];
+  stats->bytes += (cbor) ? cbor_write(*response, json) : json.printTo(*response);
+  stats->us += micros() - start;
+  stats->responses++;
+
   request->send(response);
 }
 
@@ -89,7 +128,7 @@ public:
 
 class PluginRequestHandler : public AsyncWebHandler {
 public:
-  PluginRequestHandler(const char* uri, Plugin* plugin, const int8_t sensor) : _uri(uri), _plugin(plugin), _sensor(sensor) {
+  PluginRequestHandler(const char* uri, Plugin* plugin, const int16_t sensor) : _uri(uri), _plugin(plugin), _sensor(sensor) {
   }
 
   bool canHandle(AsyncWebServerRequest *request){
@@ -97,6 +136,8 @@ public:
       return false;
     if (!request->url().startsWith(_uri))
       return false;
+    // headers not registered by a handler are dropped, needed for CBOR
+    request->addInterestingHeader(F("Accept"));
     return true;
   }
 
@@ -107,11 +148,11 @@ public:
 
     // GET - get sensor value
     if (request->method() == HTTP_GET && request->params() == 0) {
-      float val = _plugin->getValue(_sensor);
-      if (isnan(val))
+      SensorValue value;
+      if (!_plugin->getSnapshot(&value, _sensor) || !value.valid)
         json["value"] = JSON_NULL;
       else {
-        json["value"] = val;
+        json["value"] = value.val;
         res = 200;
       }
     }
@@ -124,14 +165,75 @@ public:
         res = 200;
       }
     }
+    // POST - set sensor deadband and heartbeat
+    else if ((request->method() == HTTP_POST || request->method() == HTTP_GET)
+      && (request->hasParam("deadband") || request->hasParam("relative") || request->hasParam("heartbeat"))) {
+      SensorSettings settings;
+      if (_plugin->getSettings(&settings, _sensor)) {
+        if (request->hasParam("deadband"))
+          settings.deadband = request->getParam("deadband")->value().toFloat();
+        if (request->hasParam("relative"))
+          settings.relative = request->getParam("relative")->value().toFloat();
+        if (request->hasParam("heartbeat"))
+          settings.heartbeat = request->getParam("heartbeat")->value().toInt();
+      }
+
+      if (_plugin->setSettings(&settings, _sensor)) {
+        _plugin->getSensorJson(&json, _sensor);
+        res = 200;
+      }
+    }
+
+    jsonResponse(request, res, json);
+  }
+
+protected:
+  String _uri;
+  Plugin* _plugin;
+  int16_t _sensor;
+};
+
+class PluginSettingsHandler : public AsyncWebHandler {
+public:
+  PluginSettingsHandler(const char* uri, Plugin* plugin) : _uri(uri), _plugin(plugin) {
+  }
+
+  bool canHandle(AsyncWebServerRequest *request){
+    if (request->method() != HTTP_GET && request->method() != HTTP_POST)
+      return false;
+    if (request->url() != _uri)
+      return false;
+    request->addInterestingHeader(F("Accept"));
+    return true;
+  }
+
+  void handleRequest(AsyncWebServerRequest *request) {
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& json = jsonBuffer.createObject();
+    int res = 200;
+
+    // POST - set plugin intervals, interval in s and sampling in ms
+    if (request->hasParam("interval") || request->hasParam("sampling")) {
+      uint32_t period = _plugin->getPeriod();
+      uint32_t sample = _plugin->getSamplePeriod();
+
+      if (request->hasParam("interval"))
+        period = request->getParam("interval")->value().toFloat() * 1000;
+      if (request->hasParam("sampling"))
+        sample = request->getParam("sampling")->value().toInt();
+
+      if (!_plugin->setTiming(period, sample))
+        res = 400;
+    }
 
+    json[F("name")] = _plugin->getName();
+    _plugin->getPluginJson(&json);
     jsonResponse(request, res, json);
   }
 
 protected:
   String _uri;
   Plugin* _plugin;
-  int8_t _sensor;
 };
 
 /**
@@ -174,17 +276,11 @@ void handleSettings(AsyncWebServerRequest *request)
     return;
   }
 
-  if (saveConfig()) {
-    resp += F("<h1>Settings saved.</h1>");
-  }
-  else {
-    resp += F("<h1>Failed to save config file.</h1>");
-    result = 400;
-  }
+  // saved from loop() before restart
+  configChanged(true);
+  resp += F("<h1>Settings saved.</h1>");
   resp += F("</body></html>");
-  if (result == 200) {
-    requestRestart();
-  }
+  requestRestart();
   request->send(result, F(CONTENT_TYPE_HTML), resp);
 }
 
@@ -195,7 +291,7 @@ void handleGetStatus(AsyncWebServerRequest *request)
 {
   DEBUG_MSG(SERVER, "%s (%d args)\n", request->url().c_str(), request->params());
 
-  StaticJsonBuffer<512> jsonBuffer;
+  DynamicJsonBuffer jsonBuffer;
   JsonObject& json = jsonBuffer.createObject();
 
   if (request->hasParam("initial")) {
@@ -212,6 +308,7 @@ void handleGetStatus(AsyncWebServerRequest *request)
     json[F("ssid")] = g_ssid;
     // json[F("pass")] = g_pass;
     json[F("middleware")] = g_middleware;
+    json[F("transport")] = (g_transport == TRANSPORT_MQTT) ? "mqtt" : "http";
 #ifndef ESP32
     json[F("flash")] = ESP.getFlashChipRealSize();
 #endif
@@ -223,10 +320,48 @@ void handleGetStatus(AsyncWebServerRequest *request)
   json[F("uptime")] = millis();
   json[F("heap")] = heap;
   json[F("minheap")] = g_minFreeHeap;
+  json[F("plugincycles")] = g_pluginCycles;
   json[F("resetcode")] = getResetReason(0);
 #ifdef ESP32
   json[F("resetcode1")] = getResetReason(1);
 #endif
+  JsonObject& log = json.createNestedObject("log");
+  log_getJson(&log);
+  JsonObject& boot = json.createNestedObject("boot");
+  Plugin::getBootJson(&boot);
+  JsonObject& wifi = json.createNestedObject("wifi");
+  network_getJson(&wifi);
+  JsonObject& clock = json.createNestedObject("clock");
+  clock_getJson(&clock);
+  if (g_updateServer != "") {
+    JsonObject& update = json.createNestedObject("update");
+    update_getJson(&update);
+  }
+#if defined(ESP32) && defined(ESP32_TASKS)
+  JsonObject& tasks = json.createNestedObject("tasks");
+  tasks_getJson(&tasks);
+#endif
+  JsonObject& encoding = json.createNestedObject("encoding");
+  for (uint8_t i=0; i<2; i++) {
+    JsonObject& format = encoding.createNestedObject((i) ? "cbor" : "json");
+    format[F("responses")] = g_encoding[i].responses;
+    if (g_encoding[i].responses) {
+      format[F("bytes")] = g_encoding[i].bytes / g_encoding[i].responses;
+      format[F("us")] = g_encoding[i].us / g_encoding[i].responses;
+    }
+  }
+  JsonObject& planner = json.createNestedObject("planner");
+  planner_getJson(&planner);
+  JsonObject& uploads = json.createNestedObject("uploads");
+  Plugin::getUploadJson(&uploads);
+  if (g_transport == TRANSPORT_MQTT) {
+    JsonObject& mqtt = json.createNestedObject("mqtt");
+    mqtt_getJson(&mqtt);
+  }
+  else {
+    JsonObject& http = json.createNestedObject("http");
+    middleware_getJson(&http);
+  }
   // json[F("gpio")] = (uint32_t)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16));
 
   // reset free heap
@@ -245,15 +380,151 @@ void handleGetPlugins(AsyncWebServerRequest *request)
   DynamicJsonBuffer jsonBuffer;
   JsonArray& json = jsonBuffer.createArray();
 
-  Plugin::each([&json](Plugin* plugin) {
+  // values only polls omit settings, uuids and hashes
+  bool details = !request->hasParam("values");
+  Plugin::each([&json, details](Plugin* plugin) {
     JsonObject& obj = json.createNestedObject();
     obj[F("name")] = plugin->getName();
-    plugin->getPluginJson(&obj);
+    plugin->getPluginJson(&obj, details);
   });
 
   jsonResponse(request, 200, json);
 }
 
+/**
+ * Get current values of all sensors as <plugin>/<addr>: {value, timestamp}.
+ * ETag is <bootid>-<generation>. If-None-Match returns 304 if nothing was
+ * published since, since=<bootid>-<generation> returns only sensors
+ * published later. A since from a different boot returns all sensors.
+ */
+void handleGetValues(AsyncWebServerRequest *request)
+{
+  // read before values, sensors published meanwhile are repeated next poll
+  uint32_t generation = Plugin::getGeneration();
+  char tag[20];
+  snprintf(tag, sizeof(tag), "%08x-%u", g_bootId, generation);
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%s\"", tag);
+
+  if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == etag) {
+    g_lastAccessTime = millis();
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader(F(CORS_HEADER), "*");
+    response->addHeader(F("ETag"), etag);
+    request->send(response);
+    return;
+  }
+
+  bool delta = false;
+  uint32_t since = 0;
+  if (request->hasParam("since")) {
+    const char* param = request->getParam("since")->value().c_str();
+    char* end;
+    delta = strtoul(param, &end, 16) == g_bootId && *end == '-';
+    if (delta)
+      since = strtoul(end + 1, NULL, 10);
+  }
+
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject& json = jsonBuffer.createObject();
+  json[F("generation")] = generation;
+  json[F("since")] = tag;
+  JsonObject& values = json.createNestedObject("values");
+
+  Plugin::each([&values, delta, since](Plugin* plugin) {
+    String name = plugin->getName() + "/";
+    for (int16_t sensor=0; sensor<plugin->getSensors(); sensor++) {
+      SensorValue value;
+      // generation wraps after 2^32 readings
+      if (!plugin->getSnapshot(&value, sensor) || (delta && (int32_t)(value.generation - since) <= 0))
+        continue;
+
+      char addr_c[20];
+      plugin->getAddr(addr_c, sensor);
+      JsonObject& obj = values.createNestedObject(name + addr_c);
+      if (value.valid)
+        obj[F("value")] = value.val;
+      else
+        obj[F("value")] = JSON_NULL;
+      obj[F("age")] = millis() - value.timestamp;
+      if (value.time)
+        obj[F("timestamp")] = value.time;
+    }
+  });
+
+  jsonResponse(request, 200, json, etag);
+}
+
+/**
+ * Sensor history
+ * Without sensor parameter history statistics are returned
+ */
+void handleGetHistory(AsyncWebServerRequest *request)
+{
+  DEBUG_MSG(SERVER, "%s (%d args)\n", request->url().c_str(), request->params());
+
+  if (!request->hasParam("sensor")) {
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& json = jsonBuffer.createObject();
+    history_getJson(&json);
+    jsonResponse(request, 200, json);
+    return;
+  }
+
+  HistorySeries* series = history_find(request->getParam("sensor")->value().c_str());
+  if (series == NULL) {
+    request->send(404, F(CONTENT_TYPE_PLAIN), F("Sensor not found"));
+    return;
+  }
+
+  uint32_t from = 0;
+  if (request->hasParam("from"))
+    from = request->getParam("from")->value().toInt();
+
+  // touch
+  g_lastAccessTime = millis();
+
+  // reader is released together with the response
+  std::shared_ptr<HistoryReader> reader(new HistoryReader(series, from));
+  AsyncWebServerResponse *response = request->beginChunkedResponse(F(CONTENT_TYPE_JSON), [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    return reader->readJson(buffer, maxLen);
+  });
+  response->addHeader(F(CORS_HEADER), "*");
+  request->send(response);
+}
+
+/**
+ * Get log buffer as text, set runtime level with level and optional module
+ */
+void handleGetLog(AsyncWebServerRequest *request)
+{
+  if (request->hasParam("level")) {
+    const char* module = NULL;
+    if (request->hasParam("module"))
+      module = request->getParam("module")->value().c_str();
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject& json = jsonBuffer.createObject();
+    int res = 400;
+    if (log_setLevel(module, request->getParam("level")->value().toInt()))
+      res = 200;
+    log_getJson(&json);
+    jsonResponse(request, res, json);
+    return;
+  }
+
+  // snapshot of current buffer, position is released together with the response
+  std::shared_ptr<uint32_t> position(new uint32_t(log_start()));
+  uint32_t end = log_end();
+  AsyncWebServerResponse *response = request->beginChunkedResponse(F(CONTENT_TYPE_PLAIN), [position, end](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    if ((int32_t)(end - *position) <= 0)
+      return 0;
+    return log_read(buffer, min(maxLen, (size_t)(end - *position)), *position);
+  });
+  response->addHeader(F(CORS_HEADER), "*");
+  request->send(response);
+}
+
 /**
  * Setup handlers for each plugin and sensor
  * Structure is /api/<plugin>/<sensor>
@@ -263,9 +534,12 @@ void registerPlugins()
   Plugin::each([](Plugin* plugin) {
     DEBUG_MSG(SERVER, "register plugin: %s\n", plugin->getName().c_str());
 
+    // register plugin settings handler
+    g_server.addHandler(new PluginSettingsHandler(("/api/" + plugin->getName()).c_str(), plugin));
+
     // register one handler per sensor
     String baseUri = "/api/" + plugin->getName() + "/";
-    for (int8_t sensor=0; sensor<plugin->getSensors(); sensor++) {
+    for (int16_t sensor=0; sensor<plugin->getSensors(); sensor++) {
       String uri = String(baseUri);
       char addr_c[20];
       plugin->getAddr(addr_c, sensor);
@@ -317,6 +591,8 @@ void handleWifiScan(AsyncWebServerRequest *request)
  */
 void webserver_start()
 {
+  g_bootId = random(0x7fffffff);
+
   // not found
   g_server.onNotFound(handleNotFound);
 
@@ -336,7 +612,10 @@ void webserver_start()
   // GET
   g_server.on("/api/status", HTTP_GET, handleGetStatus);
   g_server.on("/api/plugins", HTTP_GET, handleGetPlugins);
+  g_server.on("/api/values", HTTP_GET, handleGetValues);
   g_server.on("/api/scan", HTTP_GET, handleWifiScan);
+  g_server.on("/api/history", HTTP_GET, handleGetHistory);
+  g_server.on("/api/log", HTTP_GET, handleGetLog);
 
   // POST
   g_server.on("/settings", HTTP_POST, handleSettings);
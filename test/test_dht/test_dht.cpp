@@ -0,0 +1,107 @@
+/**
+ * DHT frame decoder tests, run on the host with
+ *
+ *   pio test -e native
+ *
+ * Frames are falling edge timestamps in us as captured by DHTReader,
+ * synthesized from datasheet timings with +-4us jitter: 160us response,
+ * 77us (0) or 120us (1) per bit.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "plugins/DHTFrame.h"
+
+
+// 65.2%, 23.1C
+static const uint32_t FRAME_DHT22[DHT_FRAME_EDGES] = {
+  2031417, 2031578, 2031653, 2031732, 2031805, 2031879, 2031960, 2032034,
+  2032155, 2032228, 2032352, 2032428, 2032501, 2032575, 2032697, 2032819,
+  2032893, 2032969, 2033043, 2033124, 2033203, 2033276, 2033350, 2033426,
+  2033499, 2033578, 2033694, 2033813, 2033929, 2034010, 2034085, 2034205,
+  2034327, 2034445, 2034526, 2034643, 2034763, 2034887, 2034962, 2035079,
+  2035155, 2035276,
+};
+
+// 43.7%, -5.4C
+static const uint32_t FRAME_DHT22_NEGATIVE[DHT_FRAME_EDGES] = {
+  2031417, 2031574, 2031651, 2031731, 2031805, 2031878, 2031955, 2032035,
+  2032112, 2032234, 2032355, 2032428, 2032551, 2032672, 2032747, 2032864,
+  2032944, 2033060, 2033179, 2033256, 2033331, 2033407, 2033486, 2033565,
+  2033645, 2033719, 2033794, 2033874, 2033996, 2034120, 2034197, 2034315,
+  2034437, 2034518, 2034595, 2034717, 2034838, 2034917, 2035036, 2035154,
+  2035228, 2035303,
+};
+
+// 45%, 22.5C
+static const uint32_t FRAME_DHT11[DHT_FRAME_EDGES] = {
+  2031417, 2031574, 2031655, 2031729, 2031845, 2031921, 2032044, 2032168,
+  2032247, 2032368, 2032448, 2032528, 2032606, 2032683, 2032759, 2032834,
+  2032910, 2032984, 2033061, 2033142, 2033222, 2033343, 2033423, 2033543,
+  2033660, 2033734, 2033815, 2033894, 2033969, 2034047, 2034122, 2034245,
+  2034324, 2034440, 2034514, 2034638, 2034716, 2034794, 2034915, 2034995,
+  2035075, 2035149,
+};
+
+static float temperature;
+static float humidity;
+
+
+void test_dht22() {
+  TEST_ASSERT_TRUE(dht_decode(FRAME_DHT22, DHT_FRAME_EDGES, DHT22, &temperature, &humidity));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 23.1, temperature);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 65.2, humidity);
+}
+
+void test_dht22_negative() {
+  TEST_ASSERT_TRUE(dht_decode(FRAME_DHT22_NEGATIVE, DHT_FRAME_EDGES, DHT22, &temperature, &humidity));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, -5.4, temperature);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 43.7, humidity);
+}
+
+void test_dht11() {
+  TEST_ASSERT_TRUE(dht_decode(FRAME_DHT11, DHT_FRAME_EDGES, DHT11, &temperature, &humidity));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 22.5, temperature);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 45.0, humidity);
+}
+
+void test_missed_response_edge() {
+  // interrupt attached after the response edge
+  TEST_ASSERT_TRUE(dht_decode(FRAME_DHT22 + 1, DHT_FRAME_EDGES - 1, DHT22, &temperature, &humidity));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 23.1, temperature);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 65.2, humidity);
+}
+
+void test_checksum_failure() {
+  // last checksum bit read as 1 instead of 0
+  uint32_t edges[DHT_FRAME_EDGES];
+  memcpy(edges, FRAME_DHT11, sizeof(edges));
+  TEST_ASSERT_EQUAL_UINT32(74, edges[41] - edges[40]);
+  edges[41] += 45;
+  TEST_ASSERT_FALSE(dht_decode(edges, DHT_FRAME_EDGES, DHT11, &temperature, &humidity));
+}
+
+void test_truncated_frame() {
+  TEST_ASSERT_FALSE(dht_decode(FRAME_DHT22, DHT_FRAME_EDGES - 2, DHT22, &temperature, &humidity));
+}
+
+void test_glitch() {
+  // spurious edge in the middle of a bit
+  uint32_t edges[DHT_FRAME_EDGES + 1];
+  memcpy(edges, FRAME_DHT22, 20 * sizeof(uint32_t));
+  edges[20] = FRAME_DHT22[19] + 30;
+  memcpy(edges + 21, FRAME_DHT22 + 20, (DHT_FRAME_EDGES - 20) * sizeof(uint32_t));
+  TEST_ASSERT_FALSE(dht_decode(edges, DHT_FRAME_EDGES + 1, DHT22, &temperature, &humidity));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_dht22);
+  RUN_TEST(test_dht22_negative);
+  RUN_TEST(test_dht11);
+  RUN_TEST(test_missed_response_edge);
+  RUN_TEST(test_checksum_failure);
+  RUN_TEST(test_truncated_frame);
+  RUN_TEST(test_glitch);
+  return UNITY_END();
+}
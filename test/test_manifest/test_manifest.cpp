@@ -0,0 +1,94 @@
+/**
+ * Update manifest tests, run on the host with
+ *
+ *   pio test -e native
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "manifest.h"
+
+
+#define SHA256_HEX "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08"
+
+static Manifest manifest;
+
+void setUp() {
+  manifest.version = "0.4.1";
+  manifest.image = "vzero-0.4.1.bin.gz";
+  manifest.sha256 = SHA256_HEX;
+  manifest.signature = "0a1b2c3d";
+}
+
+void test_valid() {
+  TEST_ASSERT_TRUE(manifest_valid(&manifest));
+  TEST_ASSERT_EQUAL_HEX8(0x9f, manifest.digest[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x08, manifest.digest[SHA256_SIZE - 1]);
+}
+
+void test_missing_fields() {
+  manifest.version = NULL;
+  TEST_ASSERT_FALSE(manifest_valid(&manifest));
+  setUp();
+  manifest.image = "";
+  TEST_ASSERT_FALSE(manifest_valid(&manifest));
+  setUp();
+  manifest.signature = NULL;
+  TEST_ASSERT_FALSE(manifest_valid(&manifest));
+}
+
+void test_bad_digest() {
+  // truncated and non-hex
+  manifest.sha256 = "9f86d081";
+  TEST_ASSERT_FALSE(manifest_valid(&manifest));
+  manifest.sha256 = "zz86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+  TEST_ASSERT_FALSE(manifest_valid(&manifest));
+}
+
+void test_signature() {
+  uint8_t sig[SIGNATURE_MAX_SIZE];
+  TEST_ASSERT_EQUAL_UINT32(4, manifest_signature(&manifest, sig, sizeof(sig)));
+  TEST_ASSERT_EQUAL_HEX8(0x0a, sig[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x3d, sig[3]);
+
+  // odd length, empty, larger than buffer
+  manifest.signature = "0a1b2";
+  TEST_ASSERT_EQUAL_UINT32(0, manifest_signature(&manifest, sig, sizeof(sig)));
+  manifest.signature = "";
+  TEST_ASSERT_EQUAL_UINT32(0, manifest_signature(&manifest, sig, sizeof(sig)));
+  manifest.signature = "0a1b2c3d";
+  TEST_ASSERT_EQUAL_UINT32(0, manifest_signature(&manifest, sig, 3));
+}
+
+void test_versions() {
+  TEST_ASSERT_TRUE(manifest_compareVersions("0.4.1", "0.4.0") > 0);
+  TEST_ASSERT_TRUE(manifest_compareVersions("0.4", "0.4.1") < 0);
+  TEST_ASSERT_TRUE(manifest_compareVersions("0.10.0", "0.9.9") > 0);
+  TEST_ASSERT_EQUAL_INT(0, manifest_compareVersions("0.4.1", "0.4.1"));
+  TEST_ASSERT_EQUAL_INT(0, manifest_compareVersions("0.4.1-dev", "0.4.1"));
+}
+
+void test_offset() {
+  TEST_ASSERT_EQUAL_UINT32(0, manifest_offset(0xedd834, 0));
+  TEST_ASSERT_EQUAL_UINT32(0xedd834 % 3600, manifest_offset(0xedd834, 3600));
+  TEST_ASSERT_EQUAL_UINT32(manifest_offset(0xedd834, 3600), manifest_offset(0xedd834, 3600));
+  TEST_ASSERT_TRUE(manifest_offset(0xedd835, 3600) != manifest_offset(0xedd834, 3600));
+}
+
+void test_offset_window_limit() {
+  // install time in ms must not overflow
+  TEST_ASSERT_TRUE(manifest_offset(0xffffffff, 0xffffffff) < MANIFEST_WINDOW_MAX);
+  TEST_ASSERT_TRUE(manifest_offset(0xffffffff, 0xffffffff) * 1000ULL < 0x7fffffff);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_valid);
+  RUN_TEST(test_missing_fields);
+  RUN_TEST(test_bad_digest);
+  RUN_TEST(test_signature);
+  RUN_TEST(test_versions);
+  RUN_TEST(test_offset);
+  RUN_TEST(test_offset_window_limit);
+  return UNITY_END();
+}